@@ -0,0 +1,146 @@
+#ifndef ACCESS_PATTERN_H
+#define ACCESS_PATTERN_H
+
+// Generators of block offsets for the bandwidth sweeps: sequential, strided,
+// uniform random, random within a hot window and Zipfian. All offsets are
+// multiples of the block size and the whole block fits on the device.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+
+enum class Pattern { Sequential, Strided, Random, HotWindow, Zipfian };
+
+inline bool parsePattern(const std::string& name, Pattern& pattern) {
+    if (name == "seq") pattern = Pattern::Sequential;
+    else if (name == "stride") pattern = Pattern::Strided;
+    else if (name == "random") pattern = Pattern::Random;
+    else if (name == "hot") pattern = Pattern::HotWindow;
+    else if (name == "zipf") pattern = Pattern::Zipfian;
+    else return false;
+    return true;
+}
+
+inline const char* patternName(Pattern pattern) {
+    switch (pattern) {
+        case Pattern::Sequential: return "seq";
+        case Pattern::Strided: return "stride";
+        case Pattern::Random: return "random";
+        case Pattern::HotWindow: return "hot";
+        case Pattern::Zipfian: return "zipf";
+    }
+    return "?";
+}
+
+struct PatternOptions {
+    int64_t stride_bytes = 1 << 20;     // Gap between strided accesses
+    int64_t hot_bytes = 1LL << 30;      // Size of the hot window
+    double zipf_theta = 0.99;           // Skew of the Zipfian distribution
+};
+
+class OffsetGenerator {
+public:
+    OffsetGenerator(Pattern pattern, const PatternOptions& opts, int64_t device_size,
+                    int64_t block_size, std::mt19937_64& rng)
+        : pattern_(pattern), rng_(rng), blockSize_(block_size),
+          numBlocks_(device_size / block_size) {
+        // Sequential and strided runs start at a random block so that
+        // repeated runs do not all hit the outer tracks.
+        std::uniform_int_distribution<int64_t> any(0, numBlocks_ - 1);
+        next_ = any(rng_);
+
+        if (pattern_ == Pattern::Strided) {
+            // The block itself plus the gap, rounded up to whole blocks
+            strideBlocks_ = 1 + (opts.stride_bytes + block_size - 1) / block_size;
+        }
+
+        int64_t hotBlocks = std::max<int64_t>(1, std::min(numBlocks_, opts.hot_bytes / block_size));
+        std::uniform_int_distribution<int64_t> hotStart(0, numBlocks_ - hotBlocks);
+        hotStart_ = hotStart(rng_);
+        hot_ = std::uniform_int_distribution<int64_t>(0, hotBlocks - 1);
+        uniform_ = any;
+
+        if (pattern_ == Pattern::Zipfian) {
+            initZipf(opts.zipf_theta);
+        }
+    }
+
+    int64_t next() {
+        int64_t block = 0;
+        switch (pattern_) {
+            case Pattern::Sequential:
+            case Pattern::Strided:
+                block = next_;
+                next_ = (next_ + strideBlocks_) % numBlocks_;
+                break;
+            case Pattern::Random:
+                block = uniform_(rng_);
+                break;
+            case Pattern::HotWindow:
+                block = hotStart_ + hot_(rng_);
+                break;
+            case Pattern::Zipfian:
+                block = scramble(zipfRank());
+                break;
+        }
+        return block * blockSize_;
+    }
+
+private:
+    // Zipfian ranks after Gray et al., "Quickly Generating Billion-Record
+    // Synthetic Databases" (the YCSB generator). zeta(n) is summed exactly for
+    // the first terms and approximated by its integral for the tail, which
+    // keeps setup fast on multi-terabyte devices with 4 KiB blocks.
+    void initZipf(double theta) {
+        theta_ = theta;
+        const int64_t exact = std::min<int64_t>(numBlocks_, 100000);
+        double zetan = 0;
+        for (int64_t i = 1; i <= exact; i++) {
+            zetan += std::pow(static_cast<double>(i), -theta);
+        }
+        if (numBlocks_ > exact) {
+            double a = exact + 0.5;
+            double b = numBlocks_ + 0.5;
+            zetan += (std::pow(b, 1 - theta) - std::pow(a, 1 - theta)) / (1 - theta);
+        }
+        double zeta2 = 1 + std::pow(2.0, -theta);
+        alpha_ = 1 / (1 - theta);
+        zetan_ = zetan;
+        eta_ = (1 - std::pow(2.0 / numBlocks_, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+
+    int64_t zipfRank() {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng_);
+        double uz = u * zetan_;
+        if (uz < 1) return 0;
+        if (uz < 1 + std::pow(0.5, theta_)) return 1;
+        int64_t rank = static_cast<int64_t>(numBlocks_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+        return std::min(rank, numBlocks_ - 1);
+    }
+
+    // Spreads popular ranks over the device instead of packing them at its
+    // start, so that the hot set still costs seeks.
+    int64_t scramble(int64_t rank) const {
+        uint64_t x = static_cast<uint64_t>(rank) * 0x9e3779b97f4a7c15ULL;
+        x ^= x >> 31;
+        return static_cast<int64_t>(x % static_cast<uint64_t>(numBlocks_));
+    }
+
+    Pattern pattern_;
+    std::mt19937_64& rng_;
+    int64_t blockSize_;
+    int64_t numBlocks_;
+    int64_t next_ = 0;
+    int64_t strideBlocks_ = 1;
+    int64_t hotStart_ = 0;
+    std::uniform_int_distribution<int64_t> hot_;
+    std::uniform_int_distribution<int64_t> uniform_;
+    double theta_ = 0;
+    double alpha_ = 0;
+    double zetan_ = 0;
+    double eta_ = 0;
+};
+
+#endif  // ACCESS_PATTERN_H
@@ -0,0 +1,44 @@
+#ifndef DEVICE_UTIL_H
+#define DEVICE_UTIL_H
+
+// Helpers shared by the disk benchmarks in 1.hdd and 2.hdd.
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+// Size of a block device (BLKGETSIZE64) or of a regular file, so that the
+// tests also run against a file or a loop device when no spare disk is at
+// hand.
+inline int64_t getDeviceSize(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        return -1;
+    }
+    if (S_ISREG(st.st_mode)) {
+        return st.st_size;
+    }
+
+    int64_t size;
+    if (ioctl(fd, BLKGETSIZE64, &size) == -1) {
+        perror("ioctl BLKGETSIZE64");
+        return -1;
+    }
+    return size;
+}
+
+// Value below which the given fraction of the (sorted) samples lies.
+inline double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+    return sorted[index];
+}
+
+#endif  // DEVICE_UTIL_H
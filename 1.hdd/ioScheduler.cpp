@@ -0,0 +1,122 @@
+#include "ioScheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+bool parsePolicy(const std::string& name, SchedulePolicy& policy) {
+    if (name == "fifo") policy = SchedulePolicy::Fifo;
+    else if (name == "scan") policy = SchedulePolicy::Scan;
+    else if (name == "clook") policy = SchedulePolicy::CLook;
+    else if (name == "sstf") policy = SchedulePolicy::Sstf;
+    else return false;
+    return true;
+}
+
+const char* policyName(SchedulePolicy policy) {
+    switch (policy) {
+        case SchedulePolicy::Fifo: return "fifo";
+        case SchedulePolicy::Scan: return "scan";
+        case SchedulePolicy::CLook: return "clook";
+        case SchedulePolicy::Sstf: return "sstf";
+    }
+    return "?";
+}
+
+namespace {
+
+MergedRequest single(const IoRequest& request) {
+    return MergedRequest{request.offset, request.length, {request.id}};
+}
+
+// Sorts by offset and coalesces requests that overlap or lie within
+// mergeGap of each other.
+std::vector<MergedRequest> mergeSorted(std::vector<IoRequest> batch,
+                                       const SchedulerOptions& opts) {
+    std::sort(batch.begin(), batch.end(), [](const IoRequest& a, const IoRequest& b) {
+        return a.offset < b.offset;
+    });
+    std::vector<MergedRequest> merged;
+    for (const IoRequest& request : batch) {
+        if (!merged.empty()) {
+            MergedRequest& last = merged.back();
+            int64_t lastEnd = last.offset + last.length;
+            int64_t end = std::max(lastEnd, request.offset + request.length);
+            if (request.offset <= lastEnd + opts.mergeGap &&
+                end - last.offset <= opts.maxMergedLength) {
+                last.length = end - last.offset;
+                last.ids.push_back(request.id);
+                continue;
+            }
+        }
+        merged.push_back(single(request));
+    }
+    return merged;
+}
+
+}  // namespace
+
+std::vector<MergedRequest> scheduleBatch(const std::vector<IoRequest>& batch, int64_t head,
+                                         const SchedulerOptions& opts,
+                                         const SeekModel* model) {
+    std::vector<MergedRequest> order;
+    if (opts.policy == SchedulePolicy::Fifo) {
+        for (const IoRequest& request : batch) {
+            order.push_back(single(request));
+        }
+        return order;
+    }
+
+    std::vector<MergedRequest> sorted = mergeSorted(batch, opts);
+    auto firstAbove = std::lower_bound(
+        sorted.begin(), sorted.end(), head,
+        [](const MergedRequest& r, int64_t offset) { return r.offset < offset; });
+
+    switch (opts.policy) {
+        case SchedulePolicy::Scan:
+            order.assign(firstAbove, sorted.end());
+            order.insert(order.end(), std::make_reverse_iterator(firstAbove), sorted.rend());
+            break;
+        case SchedulePolicy::CLook:
+            order.assign(firstAbove, sorted.end());
+            order.insert(order.end(), sorted.begin(), firstAbove);
+            break;
+        case SchedulePolicy::Sstf: {
+            // O(n^2), fine for the batch sizes a single disk can hold.
+            std::vector<bool> done(sorted.size());
+            for (size_t n = 0; n < sorted.size(); n++) {
+                size_t best = 0;
+                double bestCost = std::numeric_limits<double>::infinity();
+                for (size_t i = 0; i < sorted.size(); i++) {
+                    if (done[i]) {
+                        continue;
+                    }
+                    int64_t distance = sorted[i].offset - head;
+                    double cost = model ? model->expectedTime(distance)
+                                        : static_cast<double>(std::llabs(distance));
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        best = i;
+                    }
+                }
+                done[best] = true;
+                order.push_back(sorted[best]);
+                head = sorted[best].offset + sorted[best].length;
+            }
+            break;
+        }
+        case SchedulePolicy::Fifo:
+            break;
+    }
+    return order;
+}
+
+double estimateServiceTime(const std::vector<MergedRequest>& order, int64_t head,
+                           const SeekModel& model) {
+    double total = 0;
+    for (const MergedRequest& request : order) {
+        total += model.expectedTime(request.offset - head);
+        head = request.offset + request.length;
+    }
+    return total;
+}
@@ -0,0 +1,57 @@
+#ifndef IO_SCHEDULER_H
+#define IO_SCHEDULER_H
+
+// User-space ordering of a batch of pending reads before they are issued one
+// at a time. Adjacent or nearby requests are merged into one larger read;
+// the merged requests are then ordered by one of the classic policies:
+//
+//   fifo  - arrival order (the baseline)
+//   scan  - elevator: sweep up from the head, then back down
+//   clook - sweep up from the head, jump back to the lowest offset, sweep up
+//   sstf  - repeatedly the request with the smallest estimated service time
+//           under a SeekModel (shortest seek first without a model)
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "seekModel.h"
+
+enum class SchedulePolicy { Fifo, Scan, CLook, Sstf };
+
+bool parsePolicy(const std::string& name, SchedulePolicy& policy);
+const char* policyName(SchedulePolicy policy);
+
+struct IoRequest {
+    int64_t offset;
+    int64_t length;
+    uint64_t id;
+};
+
+// A read covering one or more IoRequests
+struct MergedRequest {
+    int64_t offset;
+    int64_t length;
+    std::vector<uint64_t> ids;
+};
+
+struct SchedulerOptions {
+    SchedulePolicy policy = SchedulePolicy::CLook;
+    // Requests at most this many bytes apart are merged, reading the gap
+    // instead of seeking over it. 0 merges only touching requests.
+    int64_t mergeGap = 0;
+    // Largest merged read
+    int64_t maxMergedLength = 1 << 20;
+};
+
+// Returns the order in which to issue `batch` when the head is at `head`.
+// `model` is only used by sstf and may be null.
+std::vector<MergedRequest> scheduleBatch(const std::vector<IoRequest>& batch, int64_t head,
+                                         const SchedulerOptions& opts,
+                                         const SeekModel* model);
+
+// Sum of model.expectedTime() over the seeks of `order` starting at `head`
+double estimateServiceTime(const std::vector<MergedRequest>& order, int64_t head,
+                           const SeekModel& model);
+
+#endif  // IO_SCHEDULER_H
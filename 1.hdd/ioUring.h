@@ -0,0 +1,181 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+// Minimal io_uring (raw syscalls, no liburing) that keeps many O_DIRECT
+// reads and writes in flight from a single thread.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqRing_ != MAP_FAILED) munmap(sqRing_, sqRingSize_);
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqesSize_);
+        if (fd_ != -1) close(fd_);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd_ = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd_ == -1) {
+            perror("io_uring_setup");
+            return false;
+        }
+        extArg_ = params.features & IORING_FEAT_EXT_ARG;
+
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            perror("mmap sq ring");
+            return false;
+        }
+        cqRing_ = singleMmap ? sqRing_
+                             : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            perror("mmap cq ring");
+            return false;
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            perror("mmap sqes");
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqRing_);
+        char* cq = static_cast<char*>(cqRing_);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Queue a read or write; it is handed to the kernel by the next
+    // submitAndWait(). The caller must not queue more than `entries` at once.
+    void prepareRead(int fd, void* buffer, unsigned length, int64_t offset,
+                     uint64_t userData) {
+        prepare(IORING_OP_READ, fd, buffer, length, offset, userData);
+    }
+
+    void prepareWrite(int fd, const void* buffer, unsigned length, int64_t offset,
+                      uint64_t userData) {
+        prepare(IORING_OP_WRITE, fd, buffer, length, offset, userData);
+    }
+
+    // Submits queued requests and waits until at least `minComplete` are done.
+    bool submitAndWait(unsigned minComplete) {
+        return enter(minComplete, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    // Like submitAndWait(1), but gives up after `timeoutNs`. Falls back to a
+    // plain submit (no wait) on kernels without IORING_FEAT_EXT_ARG.
+    bool submitAndWaitFor(int64_t timeoutNs) {
+        if (!extArg_) {
+            return enter(0, 0, nullptr, 0);
+        }
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutNs / 1000000000;
+        ts.tv_nsec = timeoutNs % 1000000000;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        return enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    // Calls handler(userData, result) for every available completion.
+    template <typename Handler>
+    unsigned reap(Handler&& handler) {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            handler(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    void prepare(uint8_t opcode, int fd, const void* buffer, unsigned length,
+                 int64_t offset, uint64_t userData) {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & sqMask_;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = length;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        ++pending_;
+    }
+
+    bool enter(unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+        while (true) {
+            int ret = syscall(__NR_io_uring_enter, fd_, pending_, minComplete,
+                              flags, arg, argSize);
+            if (ret >= 0) {
+                pending_ -= ret;
+                return true;
+            }
+            // A timeout is not an error; EINTR just retries the wait.
+            if (errno == ETIME) {
+                return true;
+            }
+            if (errno != EINTR) {
+                perror("io_uring_enter");
+                return false;
+            }
+        }
+    }
+
+    int fd_ = -1;
+    bool extArg_ = false;
+    void* sqRing_ = MAP_FAILED;
+    void* cqRing_ = MAP_FAILED;
+    void* sqes_ = MAP_FAILED;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    size_t sqesSize_ = 0;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned pending_ = 0;
+};
+
+#endif  // IO_URING_H
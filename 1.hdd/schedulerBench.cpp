@@ -0,0 +1,239 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "deviceUtil.h"
+#include "ioScheduler.h"
+#include "seekModel.h"
+
+// Issues batches of random reads in the order chosen by each scheduling
+// policy and compares the measured total service time against fifo. Every
+// policy gets a fresh batch and head position drawn from the same
+// distribution: replaying one batch would let the drive's cache serve the
+// later policies from what the earlier ones read. The comparison is over the
+// means across rounds; for the least noise, also turn drive read-ahead off
+// (hdparm -A0).
+
+bool readAt(int fd, void* buffer, int64_t length, int64_t offset) {
+    ssize_t done = pread(fd, buffer, length, offset);
+    if (done != length) {
+        if (done == -1) {
+            perror("pread");
+        } else {
+            std::cerr << "Error: partial read at offset " << offset << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Same measurement as seekTimeTest's default mode, used when no sample file
+// is given.
+bool calibrate(int fd, int64_t device_size, int64_t block_size, int num_samples,
+               std::mt19937_64& rng, void* buffer, std::vector<SeekSample>& samples) {
+    std::uniform_int_distribution<int64_t> dist(0, device_size / block_size - 1);
+    int64_t last_offset = 0;
+    std::cerr << "Calibrating with " << num_samples << " random reads..." << std::endl;
+    for (int i = 0; i < num_samples; i++) {
+        int64_t offset = dist(rng) * block_size;
+        auto start = std::chrono::steady_clock::now();
+        if (!readAt(fd, buffer, block_size, offset)) {
+            return false;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        samples.push_back(SeekSample{offset - last_offset, elapsed.count()});
+        last_offset = offset;
+    }
+    return true;
+}
+
+void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <device_path> [options]" << std::endl;
+    std::cerr << "  --model FILE       fit the seek model from seekTimeTest's CSV output"
+              << std::endl;
+    std::cerr << "  --calibrate N      otherwise fit it from N random reads (default 1000)"
+              << std::endl;
+    std::cerr << "  --policies LIST    any of fifo,scan,clook,sstf (default all)" << std::endl;
+    std::cerr << "  --batch N          reads per batch (default 64)" << std::endl;
+    std::cerr << "  --rounds N         batches per policy (default 20)" << std::endl;
+    std::cerr << "  --block-size N     read size in bytes (default 4096)" << std::endl;
+    std::cerr << "  --span N           spread reads over the first N bytes (default all)"
+              << std::endl;
+    std::cerr << "  --merge-gap N      merge reads at most N bytes apart (default 0)"
+              << std::endl;
+    std::cerr << "  --seed N           random seed (default time)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const char* device_path = argv[1];
+    std::string model_path;
+    int calibration_samples = 1000;
+    std::vector<SchedulePolicy> policies = {SchedulePolicy::Fifo, SchedulePolicy::Scan,
+                                            SchedulePolicy::CLook, SchedulePolicy::Sstf};
+    int batch_size = 64;
+    int rounds = 20;
+    int64_t block_size = 4096;
+    int64_t span = 0;
+    SchedulerOptions sched;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "--model") {
+            model_path = argv[++i];
+        } else if (arg == "--calibrate") {
+            calibration_samples = std::stoi(argv[++i]);
+        } else if (arg == "--policies") {
+            policies.clear();
+            std::string list = argv[++i];
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                size_t end = std::min(list.find(',', begin), list.size());
+                SchedulePolicy policy;
+                if (!parsePolicy(list.substr(begin, end - begin), policy)) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                policies.push_back(policy);
+                begin = end + 1;
+            }
+        } else if (arg == "--batch") {
+            batch_size = std::stoi(argv[++i]);
+        } else if (arg == "--rounds") {
+            rounds = std::stoi(argv[++i]);
+        } else if (arg == "--block-size") {
+            block_size = std::stoll(argv[++i]);
+        } else if (arg == "--span") {
+            span = std::stoll(argv[++i]);
+        } else if (arg == "--merge-gap") {
+            sched.mergeGap = std::stoll(argv[++i]);
+        } else if (arg == "--seed") {
+            seed = std::stoull(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (block_size <= 0 || block_size % 512 != 0 || batch_size <= 0 || rounds <= 0 ||
+        sched.mergeGap < 0) {
+        std::cerr << "Invalid options" << std::endl;
+        return 1;
+    }
+    sched.maxMergedLength = std::max<int64_t>(sched.maxMergedLength, block_size);
+
+    int fd = open(device_path, O_RDONLY | O_DIRECT);
+    if (fd == -1) {
+        perror("open");
+        return 1;
+    }
+    int64_t device_size = getDeviceSize(fd);
+    if (device_size < block_size) {
+        std::cerr << "Error: cannot use " << device_path << std::endl;
+        close(fd);
+        return 1;
+    }
+    if (span <= 0 || span > device_size) {
+        span = device_size;
+    }
+
+    void* buffer;
+    if (posix_memalign(&buffer, 4096, sched.maxMergedLength) != 0) {
+        perror("posix_memalign");
+        close(fd);
+        return 1;
+    }
+    std::mt19937_64 rng(seed);
+
+    std::vector<SeekSample> samples;
+    bool loaded = model_path.empty()
+                      ? calibrate(fd, device_size, block_size, calibration_samples, rng,
+                                  buffer, samples)
+                      : loadSeekSamples(model_path, samples);
+    SeekModel model;
+    if (!loaded || !fitSeekModel(samples, model)) {
+        free(buffer);
+        close(fd);
+        return 1;
+    }
+    printSeekModel(model);
+
+    std::uniform_int_distribution<int64_t> dist(0, span / block_size - 1);
+    std::map<SchedulePolicy, double> totals;
+    int ret = 0;
+
+    std::cout << "round,policy,requests,reads,estimated_ms,measured_ms" << std::endl;
+    for (int round = 0; round < rounds && ret == 0; round++) {
+        // Rotate the policy order so none always runs right after another
+        std::rotate(policies.begin(), policies.begin() + 1, policies.end());
+        for (SchedulePolicy policy : policies) {
+            std::vector<IoRequest> batch;
+            for (int i = 0; i < batch_size; i++) {
+                batch.push_back(IoRequest{dist(rng) * block_size, block_size,
+                                          static_cast<uint64_t>(i)});
+            }
+            int64_t park = dist(rng) * block_size;
+            int64_t head = park + block_size;
+
+            sched.policy = policy;
+            std::vector<MergedRequest> order = scheduleBatch(batch, head, sched, &model);
+
+            // Park the head, then time the whole batch
+            if (!readAt(fd, buffer, block_size, park)) {
+                ret = 1;
+                break;
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (const MergedRequest& request : order) {
+                if (!readAt(fd, buffer, request.length, request.offset)) {
+                    ret = 1;
+                    break;
+                }
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (ret != 0) {
+                break;
+            }
+
+            totals[policy] += elapsed.count();
+            std::cout << round << "," << policyName(policy) << "," << batch.size() << ","
+                      << order.size() << "," << std::fixed
+                      << estimateServiceTime(order, head, model) * 1e3 << ","
+                      << elapsed.count() * 1e3 << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+
+    if (ret == 0) {
+        std::cerr << "Mean batch service time:" << std::endl;
+        for (const auto& [policy, total] : totals) {
+            std::cerr << "  " << policyName(policy) << ": " << total / rounds * 1e3 << " ms";
+            if (totals.count(SchedulePolicy::Fifo) && policy != SchedulePolicy::Fifo) {
+                double fifo = totals[SchedulePolicy::Fifo];
+                std::cerr << " (" << std::showpos << (total / fifo - 1) * 100
+                          << std::noshowpos << "% vs fifo)";
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+    free(buffer);
+    close(fd);
+    return ret;
+}
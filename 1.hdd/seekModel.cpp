@@ -0,0 +1,188 @@
+#include "seekModel.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+double SeekModel::seekTime(int64_t distance) const {
+    int64_t d = std::llabs(distance);
+    if (d == 0) {
+        return 0;
+    }
+    if (d < crossover) {
+        return std::max(0.0, settle_s + sqrtCoef * std::sqrt(static_cast<double>(d)));
+    }
+    return std::max(0.0, linearBase_s + linearCoef * static_cast<double>(d));
+}
+
+bool loadSeekSamples(const std::string& path, std::vector<SeekSample>& samples) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        SeekSample sample;
+        char comma;
+        if (fields >> sample.distance >> comma >> sample.time_s && comma == ',') {
+            // Histogram rows carry a count as a third column
+            int64_t count = 1;
+            if (!(fields >> comma >> count) || comma != ',') {
+                count = 1;
+            }
+            samples.insert(samples.end(), count, sample);
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Samples whose |distance| falls into one power-of-two range
+struct DistanceBin {
+    double distance;           // Median |distance| of the bin
+    double medianTime;
+    double spread;             // p90 - p10 of the time
+    size_t count;
+};
+
+double quantile(std::vector<double>& values, double fraction) {
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+std::vector<DistanceBin> binSamples(const std::vector<SeekSample>& samples) {
+    const size_t kMinSamples = 10;
+    std::vector<std::vector<SeekSample>> bins(64);
+    for (const SeekSample& sample : samples) {
+        uint64_t d = std::llabs(sample.distance);
+        if (d != 0) {
+            bins[63 - __builtin_clzll(d)].push_back(sample);
+        }
+    }
+
+    std::vector<DistanceBin> result;
+    for (auto& bin : bins) {
+        if (bin.size() < kMinSamples) {
+            continue;
+        }
+        std::vector<double> distances, times;
+        for (const SeekSample& sample : bin) {
+            distances.push_back(static_cast<double>(std::llabs(sample.distance)));
+            times.push_back(sample.time_s);
+        }
+        DistanceBin b;
+        b.distance = quantile(distances, 0.5);
+        b.medianTime = quantile(times, 0.5);
+        b.spread = quantile(times, 0.9) - quantile(times, 0.1);
+        b.count = bin.size();
+        result.push_back(b);
+    }
+    return result;
+}
+
+// Least squares of y = a + b * x over points [begin, end). Returns the sum of
+// squared residuals.
+double fitLine(const std::vector<double>& x, const std::vector<double>& y, size_t begin,
+               size_t end, double& a, double& b) {
+    size_t n = end - begin;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = begin; i < end; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    double denom = n * sxx - sx * sx;
+    if (n < 2 || std::fabs(denom) < std::numeric_limits<double>::epsilon() * sxx * n) {
+        b = 0;
+        a = n ? sy / n : 0;
+    } else {
+        b = (n * sxy - sx * sy) / denom;
+        a = (sy - b * sx) / n;
+    }
+    double sse = 0;
+    for (size_t i = begin; i < end; i++) {
+        double r = y[i] - (a + b * x[i]);
+        sse += r * r;
+    }
+    return sse;
+}
+
+}  // namespace
+
+bool fitSeekModel(const std::vector<SeekSample>& samples, SeekModel& model) {
+    std::vector<DistanceBin> bins = binSamples(samples);
+    if (bins.size() < 2) {
+        std::cerr << "Error: need samples in at least two distance ranges" << std::endl;
+        return false;
+    }
+
+    // Rotational delay is uniform in [0, rotation), so within a bin the
+    // 10th-90th percentile spread is 0.8 of a revolution. Small bins give
+    // noisy spreads, so take the median weighted by sample count.
+    std::vector<DistanceBin> bySpread = bins;
+    std::sort(bySpread.begin(), bySpread.end(),
+              [](const DistanceBin& a, const DistanceBin& b) { return a.spread < b.spread; });
+    size_t total = 0;
+    for (const DistanceBin& bin : bins) {
+        total += bin.count;
+    }
+    double spread = 0;
+    size_t seen = 0;
+    for (const DistanceBin& bin : bySpread) {
+        seen += bin.count;
+        if (2 * seen >= total) {
+            spread = bin.spread;
+            break;
+        }
+    }
+    model = SeekModel();
+    model.rotation_s = spread / 0.8;
+
+    // The median time is the seek plus half a revolution.
+    std::vector<double> d, sqrtD, t;
+    for (const DistanceBin& bin : bins) {
+        d.push_back(bin.distance);
+        sqrtD.push_back(std::sqrt(bin.distance));
+        t.push_back(std::max(0.0, bin.medianTime - model.rotation_s / 2));
+    }
+
+    // Try every split between the sqrt and linear regions (including "all
+    // linear") and keep the one with the smallest total error.
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t split = 0; split < bins.size(); split++) {
+        double a1 = 0, b1 = 0, a2 = 0, b2 = 0;
+        double sse = 0;
+        if (split > 0) {
+            sse += fitLine(sqrtD, t, 0, split, a1, b1);
+        }
+        sse += fitLine(d, t, split, bins.size(), a2, b2);
+        if (sse < best) {
+            best = sse;
+            model.settle_s = a1;
+            model.sqrtCoef = b1;
+            model.linearBase_s = a2;
+            model.linearCoef = b2;
+            model.crossover = split > 0 ? static_cast<int64_t>(d[split]) : 0;
+        }
+    }
+    return true;
+}
+
+void printSeekModel(const SeekModel& model) {
+    std::cerr << "Seek model:" << std::endl;
+    std::cerr << "  settle:     " << model.settle_s * 1e3 << " ms" << std::endl;
+    std::cerr << "  short seek: " << model.sqrtCoef * 1e3 << " ms * sqrt(bytes)"
+              << " below " << model.crossover << " bytes" << std::endl;
+    std::cerr << "  long seek:  " << model.linearBase_s * 1e3 << " ms + "
+              << model.linearCoef * 1e3 * (1LL << 30) << " ms/GiB" << std::endl;
+    std::cerr << "  rotation:   " << model.rotation_s * 1e3 << " ms ("
+              << (model.rotation_s > 0 ? 60 / model.rotation_s : 0) << " RPM)" << std::endl;
+}
@@ -0,0 +1,57 @@
+#ifndef SEEK_MODEL_H
+#define SEEK_MODEL_H
+
+// Seek-cost model fitted from the `distance,time_s` samples of seekTimeTest.
+//
+// A random read costs a seek that depends on the distance, plus a rotational
+// delay that is uniform in [0, rotation) and independent of it. Short seeks
+// are dominated by acceleration and grow with sqrt(distance); long ones coast
+// at full speed and grow linearly (Ruemmler & Wilkes, "An introduction to
+// disk drive modeling"):
+//
+//   seek(d) = 0                                 d == 0
+//             settle + sqrtCoef * sqrt(d)       d <  crossover
+//             linearBase + linearCoef * d       d >= crossover
+//
+// The transfer time of the sampled block is folded into settle/linearBase.
+// On an SSD the fit degenerates to a near-constant cost and no rotation.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SeekSample {
+    int64_t distance;  // Bytes, signed as printed by seekTimeTest
+    double time_s;
+};
+
+struct SeekModel {
+    double settle_s = 0;
+    double sqrtCoef = 0;       // Seconds per sqrt(byte)
+    double linearBase_s = 0;
+    double linearCoef = 0;     // Seconds per byte
+    int64_t crossover = 0;     // Bytes; 0 means the sqrt branch is not used
+    double rotation_s = 0;     // Full revolution
+
+    // Seek only, without rotational delay
+    double seekTime(int64_t distance) const;
+
+    // Expected cost of a read `distance` bytes away: seek plus half a
+    // revolution on average.
+    double expectedTime(int64_t distance) const {
+        return seekTime(distance) + rotation_s / 2;
+    }
+};
+
+// Reads samples in seekTimeTest's CSV format (header line optional), either
+// one per line or as its --histogram counts. Returns false if the file cannot
+// be read.
+bool loadSeekSamples(const std::string& path, std::vector<SeekSample>& samples);
+
+// Fits the model; needs samples spread over at least a few distance decades.
+// Returns false if there are too few to fit anything.
+bool fitSeekModel(const std::vector<SeekSample>& samples, SeekModel& model);
+
+void printSeekModel(const SeekModel& model);
+
+#endif  // SEEK_MODEL_H
@@ -3,72 +3,116 @@
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
-#include <linux/fs.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <random>
+#include <string>
+#include <vector>
 
-int64_t getDeviceSize(int fd) {
-    int64_t size;
-    if (ioctl(fd, BLKGETSIZE64, &size) == -1) {
-        perror("ioctl BLKGETSIZE64");
-        return -1;
-    }
-    return size;
-}
+#include "accessPattern.h"
+#include "deviceUtil.h"
+#include "ioUring.h"
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <device_path>" << std::endl;
-        return 1;
+struct SeekSampleRecord {
+    int64_t distance;
+    float time_s;
+};
+
+// Streaming alternative to keeping every sample: counts per (|distance|
+// power of two, time bucket). Time buckets are log-linear, 8 per octave from
+// 1 us, so they stay within ~10% of the value up to minutes. Memory is fixed
+// however long the run is.
+class SeekHistogram {
+public:
+    static constexpr int kDistanceBuckets = 64;
+    static constexpr int kSubBuckets = 8;
+    static constexpr int kTimeBuckets = 30 * kSubBuckets;
+
+    SeekHistogram() : counts_(kDistanceBuckets * kTimeBuckets, 0) {}
+
+    void add(int64_t distance, double time_s) {
+        uint64_t d = std::llabs(distance);
+        int dBucket = d == 0 ? 0 : 64 - __builtin_clzll(d);
+        counts_[std::min(dBucket, kDistanceBuckets - 1) * kTimeBuckets + timeBucket(time_s)]++;
     }
 
-    const char* device_path = argv[1];
-    const size_t block_size = 4096;
-    const int num_samples = 1000;
+    // CSV distance_min,time_s,count: |distance| from distance_min to twice
+    // that, time at the bucket midpoint. Empty buckets are skipped.
+    void write(std::ostream& out) const {
+        out << "distance_min,time_s,count\n";
+        for (int d = 0; d < kDistanceBuckets; d++) {
+            for (int t = 0; t < kTimeBuckets; t++) {
+                uint64_t count = counts_[d * kTimeBuckets + t];
+                if (count != 0) {
+                    int64_t distanceMin = d == 0 ? 0 : int64_t(1) << (d - 1);
+                    double mid = (bucketStart(t) + bucketStart(t + 1)) / 2;
+                    out << distanceMin << "," << std::fixed << std::setprecision(9) << mid
+                        << "," << count << "\n";
+                }
+            }
+        }
+    }
 
-    // Open device with O_DIRECT
-    int fd = open(device_path, O_RDONLY | O_DIRECT);
-    if (fd == -1) {
-        perror("open");
-        return 1;
+private:
+    static int timeBucket(double time_s) {
+        double us = time_s * 1e6;
+        if (us < 1) {
+            return 0;
+        }
+        int octave = static_cast<int>(std::log2(us));
+        int sub = static_cast<int>((us / std::exp2(octave) - 1) * kSubBuckets);
+        return std::min(octave * kSubBuckets + std::min(sub, kSubBuckets - 1),
+                        kTimeBuckets - 1);
     }
 
-    // Get device size
-    int64_t device_size = getDeviceSize(fd);
-    if (device_size == -1) {
-        close(fd);
-        return 1;
+    static double bucketStart(int bucket) {
+        int octave = bucket / kSubBuckets;
+        int sub = bucket % kSubBuckets;
+        return std::exp2(octave) * (1 + static_cast<double>(sub) / kSubBuckets) * 1e-6;
     }
 
-    std::cerr << "Device size: " << device_size << " bytes ("
-              << device_size / (1024 * 1024 * 1024) << " GB)" << std::endl;
+    std::vector<uint64_t> counts_;
+};
 
+// Original mode: one synchronous read at a time, recording the distance from
+// the previous read and the access time of every sample. Samples go to a
+// preallocated buffer (or a histogram) and are written out after the run so
+// that formatting and flushing stdout stay out of the measured loop.
+int runSeekTest(int fd, int64_t device_size, size_t block_size, int64_t num_samples,
+                int duration_ms, uint64_t seed, bool histogram) {
     // Allocate aligned buffer for O_DIRECT
     void* buffer;
-    if (posix_memalign(&buffer, block_size, block_size) != 0) {
+    if (posix_memalign(&buffer, 4096, block_size) != 0) {
         perror("posix_memalign");
-        close(fd);
         return 1;
     }
 
-    // Initialize random number generator with timestamp
-    auto seed = std::chrono::system_clock::now().time_since_epoch().count();
     std::mt19937_64 rng(seed);
 
     // Calculate number of possible blocks
     int64_t num_blocks = device_size / block_size;
     std::uniform_int_distribution<int64_t> dist(0, num_blocks - 1);
 
+    std::vector<SeekSampleRecord> samples;
+    SeekHistogram hist;
+    if (!histogram) {
+        samples.reserve(num_samples);
+    }
+
     int64_t last_offset = 0;
     double total_time = 0.0;
+    int64_t done = 0;
+    auto run_start = std::chrono::steady_clock::now();
+    auto deadline = duration_ms > 0 ? run_start + std::chrono::milliseconds(duration_ms)
+                                    : std::chrono::steady_clock::time_point::max();
+    auto next_progress = run_start + std::chrono::seconds(10);
 
-    // Write CSV header to stdout
-    std::cout << "distance,time_s" << std::endl;
-
-    std::cerr << "Starting " << num_samples << " random read operations..." << std::endl;
+    std::cerr << "Starting up to " << num_samples << " random read operations (seed "
+              << seed << ")..." << std::endl;
 
-    for (int i = 0; i < num_samples; i++) {
+    for (; done < num_samples; done++) {
         // Generate random block number
         int64_t block_num = dist(rng);
         int64_t offset = block_num * block_size;
@@ -76,23 +120,18 @@ int main(int argc, char* argv[]) {
         // Calculate distance from last read (with sign)
         int64_t distance = offset - last_offset;
 
-        // Seek to position
-        if (lseek(fd, offset, SEEK_SET) == -1) {
-            perror("lseek");
-            return 1;
-        }
-
         // Measure read time
-        auto start = std::chrono::high_resolution_clock::now();
-        ssize_t bytes_read = read(fd, buffer, block_size);
-        auto end = std::chrono::high_resolution_clock::now();
+        auto start = std::chrono::steady_clock::now();
+        ssize_t bytes_read = pread(fd, buffer, block_size, offset);
+        auto end = std::chrono::steady_clock::now();
 
-        if (bytes_read != block_size) {
+        if (bytes_read != static_cast<ssize_t>(block_size)) {
             if (bytes_read == -1) {
-                perror("read");
+                perror("pread");
             } else {
                 std::cerr << "Error: partial read at offset " << offset << std::endl;
             }
+            free(buffer);
             return 1;
         }
 
@@ -100,23 +139,607 @@ int main(int argc, char* argv[]) {
         std::chrono::duration<double> elapsed = end - start;
         double time_s = elapsed.count();
 
-        // Write to stdout immediately
-        std::cout << distance << "," << std::fixed << time_s << std::endl;
+        if (histogram) {
+            hist.add(distance, time_s);
+        } else {
+            samples.push_back(SeekSampleRecord{distance, static_cast<float>(time_s)});
+        }
         last_offset = offset;
         total_time += time_s;
 
-        if ((i + 1) % (num_samples / 10) == 0) {
-            std::cerr << "Progress: " << (i + 1) << "/" << num_samples << std::endl;
+        if (end >= deadline) {
+            done++;
+            break;
+        }
+        if (end >= next_progress) {
+            std::cerr << "Progress: " << done + 1 << "/" << num_samples << std::endl;
+            next_progress = end + std::chrono::seconds(10);
+        }
+    }
+
+    if (histogram) {
+        hist.write(std::cout);
+    } else {
+        std::cout << "distance,time_s\n" << std::fixed << std::setprecision(9);
+        for (const SeekSampleRecord& sample : samples) {
+            std::cout << sample.distance << "," << sample.time_s << "\n";
         }
     }
+    std::cout.flush();
 
-    double avg_time = total_time / num_samples;
-    std::cerr << "Completed " << num_samples << " measurements" << std::endl;
+    double avg_time = total_time / done;
+    std::cerr << "Completed " << done << " measurements" << std::endl;
     std::cerr << "Average seek time: " << std::fixed << avg_time << " seconds" << std::endl;
 
-    // Cleanup
     free(buffer);
-    close(fd);
+    return 0;
+}
+
+// Keeps `depth` random reads in flight for `num_ops` reads and appends a CSV
+// line with IOPS, bandwidth and latency percentiles. With a deep queue the
+// drive (NCQ) and the kernel elevator can reorder requests to shorten seeks.
+bool runQueueDepth(int fd, int64_t device_size, size_t block_size, unsigned depth,
+                   int num_ops, std::mt19937_64& rng) {
+    IoUring ring;
+    if (!ring.init(depth)) {
+        return false;
+    }
+
+    // One aligned buffer per in-flight read
+    void* buffers;
+    if (posix_memalign(&buffers, 4096, block_size * depth) != 0) {
+        perror("posix_memalign");
+        return false;
+    }
+
+    int64_t num_blocks = device_size / block_size;
+    std::uniform_int_distribution<int64_t> dist(0, num_blocks - 1);
+    std::vector<std::chrono::steady_clock::time_point> submitted(depth);
+    std::vector<double> latencies;
+    latencies.reserve(num_ops);
 
+    unsigned inflight = 0;
+    auto issue = [&](unsigned slot) {
+        ++inflight;
+        submitted[slot] = std::chrono::steady_clock::now();
+        ring.prepareRead(fd, static_cast<char*>(buffers) + slot * block_size,
+                         block_size, dist(rng) * block_size, slot);
+    };
+
+    int issued = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned slot = 0; slot < depth && issued < num_ops; ++slot, ++issued) {
+        issue(slot);
+    }
+
+    bool ok = true;
+    while (ok && static_cast<int>(latencies.size()) < num_ops) {
+        if (!ring.submitAndWait(1)) {
+            ok = false;
+            break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        ring.reap([&](uint64_t slot, int res) {
+            --inflight;
+            if (res != static_cast<int>(block_size)) {
+                std::cerr << "Error: read returned " << res
+                          << (res < 0 ? std::string(" (") + strerror(-res) + ")" : "")
+                          << std::endl;
+                ok = false;
+                return;
+            }
+            std::chrono::duration<double> latency = now - submitted[slot];
+            latencies.push_back(latency.count());
+            if (ok && issued < num_ops) {
+                issue(slot);
+                ++issued;
+            }
+        });
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    // After an error other reads may still be landing in `buffers`. Wait for
+    // them before freeing it, and if even that fails, leak the buffers rather
+    // than let the device write into memory that has been reused.
+    while (inflight > 0 && ring.submitAndWait(1)) {
+        ring.reap([&](uint64_t, int) { --inflight; });
+    }
+    if (inflight == 0) {
+        free(buffers);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double iops = latencies.size() / elapsed.count();
+    std::cout << depth << "," << std::fixed << iops << ","
+              << iops * block_size / (1024 * 1024) << ","
+              << percentile(latencies, 0.5) * 1e6 << ","
+              << percentile(latencies, 0.9) * 1e6 << ","
+              << percentile(latencies, 0.99) * 1e6 << ","
+              << percentile(latencies, 0.999) * 1e6 << ","
+              << latencies.back() * 1e6 << std::endl;
+    return true;
+}
+
+// Deepest io_uring the kernel sets up (IORING_MAX_ENTRIES); the sweep's
+// deepest run needs a ring of that many entries.
+const unsigned kMaxQueueDepth = 32768;
+
+int runQueueDepthSweep(int fd, int64_t device_size, size_t block_size,
+                       unsigned max_depth, int ops_per_depth, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+
+    std::cout << "depth,iops,mib_per_s,p50_us,p90_us,p99_us,p999_us,max_us" << std::endl;
+    for (unsigned depth = 1; depth <= max_depth; depth *= 2) {
+        std::cerr << "Queue depth " << depth << ": " << ops_per_depth
+                  << " random reads..." << std::endl;
+        if (!runQueueDepth(fd, device_size, block_size, depth, ops_per_depth, rng)) {
+            return 1;
+        }
+    }
     return 0;
 }
+
+// One bandwidth-surface point: synchronous reads or writes of `block_size`
+// bytes at offsets from `pattern` for `duration_ms`, one at a time. Small
+// random blocks are dominated by the seek and rotation before each transfer;
+// as blocks grow the transfer takes over and random approaches sequential
+// bandwidth. The block size where that happens is what the surface shows.
+bool runSurfacePoint(int fd, int64_t device_size, Pattern pattern, bool write,
+                     size_t block_size, int duration_ms, const PatternOptions& popts,
+                     std::mt19937_64& rng, void* buffer) {
+    OffsetGenerator offsets(pattern, popts, device_size, block_size, rng);
+    std::vector<double> latencies;
+    latencies.reserve(4096);
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(duration_ms);
+    auto now = start;
+    // At least a few operations even when a single one outlasts the deadline
+    while (now < deadline || latencies.size() < 4) {
+        int64_t offset = offsets.next();
+        ssize_t done = write ? pwrite(fd, buffer, block_size, offset)
+                             : pread(fd, buffer, block_size, offset);
+        auto end = std::chrono::steady_clock::now();
+        if (done != static_cast<ssize_t>(block_size)) {
+            if (done == -1) {
+                perror(write ? "pwrite" : "pread");
+            } else {
+                std::cerr << "Error: partial transfer at offset " << offset << std::endl;
+            }
+            return false;
+        }
+        std::chrono::duration<double> latency = end - now;
+        latencies.push_back(latency.count());
+        now = end;
+    }
+    std::chrono::duration<double> elapsed = now - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    double iops = latencies.size() / elapsed.count();
+    std::cout << patternName(pattern) << "," << (write ? "write" : "read") << ","
+              << block_size << "," << latencies.size() << "," << std::fixed
+              << iops * block_size / (1024 * 1024) << "," << iops << ","
+              << elapsed.count() / latencies.size() * 1e6 << ","
+              << percentile(latencies, 0.99) * 1e6 << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    return true;
+}
+
+int runBandwidthSurface(int fd, int64_t device_size, const std::vector<Pattern>& patterns,
+                        const std::vector<bool>& writes, size_t min_block, size_t max_block,
+                        int duration_ms, const PatternOptions& popts, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+
+    void* buffer;
+    if (posix_memalign(&buffer, 4096, max_block) != 0) {
+        perror("posix_memalign");
+        return 1;
+    }
+    // Written blocks carry random data rather than zeros
+    for (size_t i = 0; i < max_block / 8; i++) {
+        static_cast<uint64_t*>(buffer)[i] = rng();
+    }
+
+    std::cout << "pattern,op,block_size,ops,mib_per_s,iops,avg_us,p99_us" << std::endl;
+    int ret = 0;
+    for (bool write : writes) {
+        for (Pattern pattern : patterns) {
+            for (size_t block_size = min_block; block_size <= max_block; block_size *= 2) {
+                if (static_cast<int64_t>(block_size) > device_size) {
+                    break;
+                }
+                std::cerr << patternName(pattern) << " " << (write ? "write" : "read")
+                          << " " << block_size << " bytes..." << std::endl;
+                if (!runSurfacePoint(fd, device_size, pattern, write, block_size,
+                                     duration_ms, popts, rng, buffer)) {
+                    ret = 1;
+                    break;
+                }
+            }
+        }
+    }
+    free(buffer);
+    return ret;
+}
+
+// Sequential bandwidth at `num_zones` evenly spaced offsets. Outer tracks
+// hold more sectors per revolution, so on an HDD bandwidth falls from the
+// start of the device towards its end in steps (zones). The CSV ranks the
+// zones so that placement can put hot data on the fastest ones.
+int runZoneMap(int fd, int64_t device_size, int num_zones, int64_t zone_bytes,
+               size_t chunk_bytes) {
+    void* buffer;
+    if (posix_memalign(&buffer, 4096, chunk_bytes) != 0) {
+        perror("posix_memalign");
+        return 1;
+    }
+
+    int64_t spacing = device_size / num_zones;
+    int64_t measured = std::min(zone_bytes, spacing) / chunk_bytes * chunk_bytes;
+    if (measured < static_cast<int64_t>(2 * chunk_bytes)) {
+        std::cerr << "Error: zones too small for two " << chunk_bytes << "-byte chunks"
+                  << std::endl;
+        free(buffer);
+        return 1;
+    }
+
+    std::vector<int64_t> offsets;
+    std::vector<double> bandwidth;
+    for (int zone = 0; zone < num_zones; zone++) {
+        int64_t offset = zone * spacing / 4096 * 4096;
+        // The first chunk pays for the seek; time only the streaming part.
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t pos = 0; pos < measured; pos += chunk_bytes) {
+            if (pos == static_cast<int64_t>(chunk_bytes)) {
+                start = std::chrono::steady_clock::now();
+            }
+            ssize_t done = pread(fd, buffer, chunk_bytes, offset + pos);
+            if (done != static_cast<ssize_t>(chunk_bytes)) {
+                if (done == -1) {
+                    perror("pread");
+                } else {
+                    std::cerr << "Error: partial read at offset " << offset + pos << std::endl;
+                }
+                free(buffer);
+                return 1;
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        offsets.push_back(offset);
+        bandwidth.push_back((measured - chunk_bytes) / elapsed.count() / (1024 * 1024));
+        if ((zone + 1) % std::max(1, num_zones / 10) == 0) {
+            std::cerr << "Progress: " << zone + 1 << "/" << num_zones << " zones" << std::endl;
+        }
+    }
+    free(buffer);
+
+    std::vector<int> byBandwidth(num_zones);
+    for (int zone = 0; zone < num_zones; zone++) {
+        byBandwidth[zone] = zone;
+    }
+    std::sort(byBandwidth.begin(), byBandwidth.end(),
+              [&](int a, int b) { return bandwidth[a] > bandwidth[b]; });
+    std::vector<int> rank(num_zones);
+    for (int i = 0; i < num_zones; i++) {
+        rank[byBandwidth[i]] = i + 1;
+    }
+
+    double fastest = bandwidth[byBandwidth[0]];
+    std::cout << "zone,offset,length,mib_per_s,relative,rank\n";
+    for (int zone = 0; zone < num_zones; zone++) {
+        int64_t end = zone + 1 < num_zones ? (zone + 1) * spacing / 4096 * 4096 : device_size;
+        std::cout << zone << "," << offsets[zone] << "," << end - offsets[zone] << ","
+                  << std::fixed << std::setprecision(1) << bandwidth[zone] << ","
+                  << std::setprecision(3) << bandwidth[zone] / fastest << "," << rank[zone]
+                  << "\n";
+    }
+    std::cout.flush();
+    return 0;
+}
+
+// Reads one block, waits `gap`, and reads the same block again. The second
+// read has to wait until the block passes under the head again, so its
+// latency falls as the gap grows and jumps back up by a full revolution
+// each time the gap crosses a multiple of the rotation period. The period is
+// estimated from the spacing of those jumps.
+//
+// The drive must not serve the second read from its cache; disable read
+// look-ahead and caching first (e.g. hdparm -A0 -W0), otherwise the curve is
+// flat and no period is found.
+int runRotation(int fd, int64_t device_size, size_t block_size, int max_gap_us,
+                int gap_step_us, int repeats, uint64_t seed) {
+    void* buffer;
+    if (posix_memalign(&buffer, 4096, block_size) != 0) {
+        perror("posix_memalign");
+        return 1;
+    }
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int64_t> dist(0, device_size / block_size - 1);
+    int64_t offset = dist(rng) * block_size;
+
+    auto readBlock = [&]() {
+        if (pread(fd, buffer, block_size, offset) != static_cast<ssize_t>(block_size)) {
+            perror("pread");
+            return false;
+        }
+        return true;
+    };
+
+    std::vector<int> gaps;
+    std::vector<double> medians;
+    std::vector<double> latencies(repeats);
+    std::cerr << "Re-reading offset " << offset << " with gaps up to " << max_gap_us
+              << " us..." << std::endl;
+    for (int gap = 0; gap <= max_gap_us; gap += gap_step_us) {
+        for (int r = 0; r < repeats; r++) {
+            if (!readBlock()) {
+                free(buffer);
+                return 1;
+            }
+            // Busy-wait: sleeping would add scheduler jitter of its own.
+            auto resume = std::chrono::steady_clock::now() + std::chrono::microseconds(gap);
+            while (std::chrono::steady_clock::now() < resume) {
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (!readBlock()) {
+                free(buffer);
+                return 1;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            latencies[r] = elapsed.count() * 1e6;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        gaps.push_back(gap);
+        medians.push_back(percentile(latencies, 0.5));
+    }
+    free(buffer);
+
+    std::cout << "gap_us,latency_us\n" << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < gaps.size(); i++) {
+        std::cout << gaps[i] << "," << medians[i] << "\n";
+    }
+    std::cout.flush();
+
+    // A jump is a rise of more than half the observed range between
+    // neighbouring gaps.
+    double lo = *std::min_element(medians.begin(), medians.end());
+    double hi = *std::max_element(medians.begin(), medians.end());
+    std::vector<int> jumps;
+    for (size_t i = 1; i < medians.size(); i++) {
+        if (medians[i] - medians[i - 1] > (hi - lo) / 2) {
+            jumps.push_back(gaps[i]);
+        }
+    }
+    if (jumps.empty() || hi - lo < 100) {
+        std::cerr << "No rotation period found (latency range " << hi - lo
+                  << " us); is the drive cache disabled, or is this not an HDD?" << std::endl;
+        return 0;
+    }
+    double period_us = jumps.size() > 1
+                           ? static_cast<double>(jumps.back() - jumps.front()) / (jumps.size() - 1)
+                           : jumps.front();
+    std::cerr << "Rotation period: " << period_us / 1000 << " ms (" << 60e6 / period_us
+              << " RPM), average rotational latency " << period_us / 2000 << " ms" << std::endl;
+    return 0;
+}
+
+// Splits "a,b,c" into its elements.
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        items.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog
+              << " <device_path> [--mode seek|qd|surface|zones|rotation] [options]"
+              << std::endl;
+    std::cerr << "  <device_path>    block device, loop device or regular file" << std::endl;
+    std::cerr << "  --mode seek      one read at a time, CSV distance,time_s (default)" << std::endl;
+    std::cerr << "  --mode qd        io_uring queue-depth sweep 1..max-depth, CSV of IOPS,"
+              << " bandwidth and latency percentiles" << std::endl;
+    std::cerr << "  --block-size N   read size in bytes (default 4096)" << std::endl;
+    std::cerr << "  --samples N      reads per run, or per depth in qd mode (default 1000)"
+              << std::endl;
+    std::cerr << "  --duration-ms N  seek: stop after N ms even if samples remain;"
+              << " surface: time per point (default 1000)" << std::endl;
+    std::cerr << "  --histogram      seek: print counts per distance and time bucket"
+              << " instead of every sample" << std::endl;
+    std::cerr << "  --seed N         random seed, printed on stderr (default time)" << std::endl;
+    std::cerr << "  --max-depth N    deepest queue of the sweep, at most " << kMaxQueueDepth
+              << " (default 256)" << std::endl;
+    std::cerr << "  --mode surface   bandwidth of every pattern, operation and block size,"
+              << " CSV pattern,op,block_size,..." << std::endl;
+    std::cerr << "  --patterns LIST  any of seq,stride,random,hot,zipf (default all)" << std::endl;
+    std::cerr << "  --ops LIST       read and/or write (default read); writes destroy data"
+              << std::endl;
+    std::cerr << "  --min-block N    smallest block of the surface (default 4096)" << std::endl;
+    std::cerr << "  --max-block N    largest block of the surface (default 16 MiB)" << std::endl;
+    std::cerr << "  --stride N       gap in bytes between strided blocks (default 1 MiB)"
+              << std::endl;
+    std::cerr << "  --hot-bytes N    size of the hot window (default 1 GiB)" << std::endl;
+    std::cerr << "  --zipf-theta T   Zipfian skew, 0 < T < 1 (default 0.99)" << std::endl;
+    std::cerr << "  --mode zones     sequential bandwidth at evenly spaced offsets, CSV zone map"
+              << " ranked by bandwidth" << std::endl;
+    std::cerr << "  --zones N        number of zones (default 64)" << std::endl;
+    std::cerr << "  --zone-bytes N   bytes read per zone (default 64 MiB)" << std::endl;
+    std::cerr << "  --chunk-bytes N  read size for zones (default 1 MiB)" << std::endl;
+    std::cerr << "  --mode rotation  re-read one block after growing gaps, CSV gap_us,latency_us"
+              << " and the rotation period on stderr" << std::endl;
+    std::cerr << "  --max-gap-us N   largest gap (default 25000)" << std::endl;
+    std::cerr << "  --gap-step-us N  gap increment (default 250)" << std::endl;
+    std::cerr << "  --repeats N      re-reads per gap, median is reported (default 5)"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const char* device_path = argv[1];
+    std::string mode = "seek";
+    size_t block_size = 4096;
+    int64_t num_samples = 1000;
+    unsigned max_depth = 256;
+    std::vector<Pattern> patterns = {Pattern::Sequential, Pattern::Strided, Pattern::Random,
+                                     Pattern::HotWindow, Pattern::Zipfian};
+    std::vector<bool> writes = {false};
+    size_t min_block = 4096;
+    size_t max_block = 16 << 20;
+    int duration_ms = -1;
+    bool histogram = false;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    PatternOptions popts;
+    int num_zones = 64;
+    int64_t zone_bytes = 64 << 20;
+    size_t chunk_bytes = 1 << 20;
+    int max_gap_us = 25000;
+    int gap_step_us = 250;
+    int repeats = 5;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mode" && i + 1 < argc) {
+            mode = argv[++i];
+        } else if (arg == "--block-size" && i + 1 < argc) {
+            block_size = std::stoull(argv[++i]);
+        } else if (arg == "--samples" && i + 1 < argc) {
+            num_samples = std::stoll(argv[++i]);
+        } else if (arg == "--max-depth" && i + 1 < argc) {
+            max_depth = std::stoul(argv[++i]);
+        } else if (arg == "--patterns" && i + 1 < argc) {
+            patterns.clear();
+            for (const std::string& name : splitList(argv[++i])) {
+                Pattern pattern;
+                if (!parsePattern(name, pattern)) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                patterns.push_back(pattern);
+            }
+        } else if (arg == "--ops" && i + 1 < argc) {
+            writes.clear();
+            for (const std::string& op : splitList(argv[++i])) {
+                if (op != "read" && op != "write") {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                writes.push_back(op == "write");
+            }
+        } else if (arg == "--min-block" && i + 1 < argc) {
+            min_block = std::stoull(argv[++i]);
+        } else if (arg == "--max-block" && i + 1 < argc) {
+            max_block = std::stoull(argv[++i]);
+        } else if (arg == "--duration-ms" && i + 1 < argc) {
+            duration_ms = std::stoi(argv[++i]);
+        } else if (arg == "--histogram") {
+            histogram = true;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--zones" && i + 1 < argc) {
+            num_zones = std::stoi(argv[++i]);
+        } else if (arg == "--zone-bytes" && i + 1 < argc) {
+            zone_bytes = std::stoll(argv[++i]);
+        } else if (arg == "--chunk-bytes" && i + 1 < argc) {
+            chunk_bytes = std::stoull(argv[++i]);
+        } else if (arg == "--max-gap-us" && i + 1 < argc) {
+            max_gap_us = std::stoi(argv[++i]);
+        } else if (arg == "--gap-step-us" && i + 1 < argc) {
+            gap_step_us = std::stoi(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::stoi(argv[++i]);
+        } else if (arg == "--stride" && i + 1 < argc) {
+            popts.stride_bytes = std::stoll(argv[++i]);
+        } else if (arg == "--hot-bytes" && i + 1 < argc) {
+            popts.hot_bytes = std::stoll(argv[++i]);
+        } else if (arg == "--zipf-theta" && i + 1 < argc) {
+            popts.zipf_theta = std::stod(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (mode != "seek" && mode != "qd" && mode != "surface" && mode != "zones" &&
+        mode != "rotation") {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (block_size == 0 || block_size % 512 != 0 || num_samples < 10) {
+        std::cerr << "Block size must be a multiple of 512 and samples at least 10"
+                  << std::endl;
+        return 1;
+    }
+    if (max_depth == 0 || max_depth > kMaxQueueDepth) {
+        std::cerr << "Max depth must be between 1 and " << kMaxQueueDepth << std::endl;
+        return 1;
+    }
+    if (min_block == 0 || min_block % 4096 != 0 || max_block < min_block ||
+        popts.stride_bytes < 0 || popts.hot_bytes <= 0 || popts.zipf_theta <= 0 ||
+        popts.zipf_theta >= 1) {
+        std::cerr << "Surface blocks must be multiples of 4096 and 0 < zipf theta < 1"
+                  << std::endl;
+        return 1;
+    }
+    if (num_zones <= 0 || chunk_bytes == 0 || chunk_bytes % 4096 != 0 || max_gap_us < 0 ||
+        gap_step_us <= 0 || repeats <= 0) {
+        std::cerr << "Zones and chunk must be positive, chunk a multiple of 4096,"
+                  << " gap step and repeats positive" << std::endl;
+        return 1;
+    }
+    bool any_write = mode == "surface" &&
+                     std::find(writes.begin(), writes.end(), true) != writes.end();
+
+    // Open device with O_DIRECT
+    int fd = open(device_path, (any_write ? O_RDWR : O_RDONLY) | O_DIRECT);
+    if (fd == -1) {
+        perror("open");
+        return 1;
+    }
+
+    // Get device size
+    int64_t device_size = getDeviceSize(fd);
+    if (device_size == -1) {
+        close(fd);
+        return 1;
+    }
+    if (device_size < static_cast<int64_t>(block_size)) {
+        std::cerr << "Error: " << device_path << " is smaller than one block" << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    std::cerr << "Device size: " << device_size << " bytes ("
+              << device_size / (1024 * 1024 * 1024) << " GB)" << std::endl;
+
+    int ret;
+    if (mode == "qd") {
+        ret = runQueueDepthSweep(fd, device_size, block_size, max_depth, num_samples, seed);
+    } else if (mode == "surface") {
+        ret = runBandwidthSurface(fd, device_size, patterns, writes, min_block, max_block,
+                                  duration_ms > 0 ? duration_ms : 1000, popts, seed);
+    } else if (mode == "zones") {
+        ret = runZoneMap(fd, device_size, num_zones, zone_bytes, chunk_bytes);
+    } else if (mode == "rotation") {
+        ret = runRotation(fd, device_size, block_size, max_gap_us, gap_step_us, repeats, seed);
+    } else {
+        ret = runSeekTest(fd, device_size, block_size, num_samples, duration_ms, seed,
+                          histogram);
+    }
+
+    // Cleanup
+    close(fd);
+
+    return ret;
+}
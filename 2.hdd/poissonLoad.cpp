@@ -0,0 +1,279 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../1.hdd/deviceUtil.h"
+#include "../1.hdd/ioUring.h"
+
+// Open-loop random I/O load generator: requests arrive as a Poisson process
+// at a target rate, independently of how fast earlier ones complete. Each
+// request is timed from its scheduled arrival, so time spent waiting for a
+// free slot (queueing) is reported next to the time spent in the kernel and
+// the device (service) instead of being silently omitted, as it would be in a
+// closed loop that only issues a request after the previous one finished.
+
+struct LoadOptions {
+    size_t block_size = 4096;
+    int read_percent = 100;
+    unsigned max_inflight = 256;
+    int duration_ms = 2000;
+};
+
+struct LoadResult {
+    double target_iops;
+    double achieved_iops;
+    int64_t backlog;
+    std::vector<double> queue_us;
+    std::vector<double> service_us;
+    std::vector<double> total_us;
+};
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs one load point for opts.duration_ms. Arrivals that find all
+// max_inflight slots busy wait in user space; arrivals still waiting when the
+// run ends are reported as backlog.
+bool runLoad(int fd, int64_t device_size, const LoadOptions& opts, double target_iops,
+             std::mt19937_64& rng, char* buffers, LoadResult& result) {
+    IoUring ring;
+    if (!ring.init(opts.max_inflight)) {
+        return false;
+    }
+
+    std::exponential_distribution<double> interarrival(target_iops / 1e9);
+    std::uniform_int_distribution<int64_t> block(0, device_size / opts.block_size - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::vector<unsigned> free_slots;
+    for (unsigned slot = 0; slot < opts.max_inflight; ++slot) {
+        free_slots.push_back(opts.max_inflight - 1 - slot);
+    }
+    std::vector<int64_t> arrival(opts.max_inflight), submitted(opts.max_inflight);
+
+    size_t expected = static_cast<size_t>(target_iops * opts.duration_ms / 1000 * 1.2) + 1024;
+    result.target_iops = target_iops;
+    result.queue_us.clear();
+    result.service_us.clear();
+    result.total_us.clear();
+    result.queue_us.reserve(expected);
+    result.service_us.reserve(expected);
+    result.total_us.reserve(expected);
+
+    bool ok = true;
+    auto complete = [&](uint64_t slot, int res) {
+        if (res != static_cast<int>(opts.block_size)) {
+            std::cerr << "Error: I/O returned " << res
+                      << (res < 0 ? std::string(" (") + strerror(-res) + ")" : "")
+                      << std::endl;
+            ok = false;
+        }
+        int64_t done = nowNs();
+        result.queue_us.push_back((submitted[slot] - arrival[slot]) / 1e3);
+        result.service_us.push_back((done - submitted[slot]) / 1e3);
+        result.total_us.push_back((done - arrival[slot]) / 1e3);
+        free_slots.push_back(slot);
+    };
+
+    int64_t start = nowNs();
+    int64_t end = start + static_cast<int64_t>(opts.duration_ms) * 1000000;
+    double next_arrival = start + interarrival(rng);
+
+    while (ok) {
+        int64_t now = nowNs();
+        if (now >= end) {
+            break;
+        }
+        // Issue everything whose arrival time has passed, oldest first.
+        while (next_arrival <= now && !free_slots.empty()) {
+            unsigned slot = free_slots.back();
+            free_slots.pop_back();
+            arrival[slot] = static_cast<int64_t>(next_arrival);
+            submitted[slot] = now;
+            char* buffer = buffers + slot * opts.block_size;
+            int64_t offset = block(rng) * opts.block_size;
+            if (percent(rng) < opts.read_percent) {
+                ring.prepareRead(fd, buffer, opts.block_size, offset, slot);
+            } else {
+                ring.prepareWrite(fd, buffer, opts.block_size, offset, slot);
+            }
+            next_arrival += interarrival(rng);
+        }
+
+        // Sleep until the next arrival or completion, whichever comes first.
+        int64_t wake = std::min<int64_t>(end, static_cast<int64_t>(next_arrival));
+        bool wait_for_slot = free_slots.empty() && next_arrival <= now;
+        if (wait_for_slot) {
+            ok = ring.submitAndWait(1);
+        } else {
+            ok = ring.submitAndWaitFor(std::max<int64_t>(wake - nowNs(), 0));
+        }
+        ring.reap(complete);
+    }
+
+    // Drain requests still in flight; they count towards throughput.
+    while (ok && free_slots.size() < opts.max_inflight) {
+        ok = ring.submitAndWait(1);
+        ring.reap(complete);
+    }
+    int64_t finish = nowNs();
+
+    result.backlog = 0;
+    for (; next_arrival < end; next_arrival += interarrival(rng)) {
+        ++result.backlog;
+    }
+    result.achieved_iops = result.total_us.size() / ((finish - start) / 1e9);
+    std::sort(result.queue_us.begin(), result.queue_us.end());
+    std::sort(result.service_us.begin(), result.service_us.end());
+    std::sort(result.total_us.begin(), result.total_us.end());
+    return ok;
+}
+
+void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <device_path> [options]" << std::endl;
+    std::cerr << "  --block-size N     request size in bytes (default 4096)" << std::endl;
+    std::cerr << "  --read-percent P   share of reads, the rest are writes (default 100)"
+              << std::endl;
+    std::cerr << "  --iops N           run a single point at N requests/s" << std::endl;
+    std::cerr << "  --start-iops N     first point of the sweep (default 100)" << std::endl;
+    std::cerr << "  --step F           rate multiplier between points (default 1.5)"
+              << std::endl;
+    std::cerr << "  --max-iops N       last point of the sweep (default 1000000)" << std::endl;
+    std::cerr << "  --max-inflight N   requests the device may hold at once (default 256)"
+              << std::endl;
+    std::cerr << "  --duration-ms N    length of each point (default 2000)" << std::endl;
+    std::cerr << "  --seed N           random seed for arrivals and offsets (default time)"
+              << std::endl;
+    std::cerr << "The sweep stops at the first point that cannot keep up with its target"
+              << " rate. Writes destroy the data on the device." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const char* device_path = argv[1];
+    LoadOptions opts;
+    double single_iops = 0;
+    double start_iops = 100;
+    double step = 1.5;
+    double max_iops = 1000000;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "--block-size") {
+            opts.block_size = std::stoull(argv[++i]);
+        } else if (arg == "--read-percent") {
+            opts.read_percent = std::stoi(argv[++i]);
+        } else if (arg == "--iops") {
+            single_iops = std::stod(argv[++i]);
+        } else if (arg == "--start-iops") {
+            start_iops = std::stod(argv[++i]);
+        } else if (arg == "--step") {
+            step = std::stod(argv[++i]);
+        } else if (arg == "--max-iops") {
+            max_iops = std::stod(argv[++i]);
+        } else if (arg == "--max-inflight") {
+            opts.max_inflight = std::stoul(argv[++i]);
+        } else if (arg == "--duration-ms") {
+            opts.duration_ms = std::stoi(argv[++i]);
+        } else if (arg == "--seed") {
+            seed = std::stoull(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.block_size == 0 || opts.block_size % 512 != 0 || opts.read_percent < 0 ||
+        opts.read_percent > 100 || opts.max_inflight == 0 || opts.duration_ms <= 0 ||
+        start_iops <= 0 || step <= 1.0) {
+        std::cerr << "Invalid options" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    bool writes = opts.read_percent < 100;
+    int fd = open(device_path, (writes ? O_RDWR : O_RDONLY) | O_DIRECT);
+    if (fd == -1) {
+        perror("open");
+        return 1;
+    }
+    int64_t device_size = getDeviceSize(fd);
+    if (device_size < static_cast<int64_t>(opts.block_size)) {
+        std::cerr << "Error: cannot use " << device_path << std::endl;
+        close(fd);
+        return 1;
+    }
+    std::cerr << "Device size: " << device_size << " bytes, "
+              << opts.read_percent << "% reads of " << opts.block_size << " bytes" << std::endl;
+
+    // Aligned buffers for O_DIRECT, one per slot; writes send random data.
+    void* buffers;
+    if (posix_memalign(&buffers, 4096, opts.block_size * opts.max_inflight) != 0) {
+        perror("posix_memalign");
+        close(fd);
+        return 1;
+    }
+    std::mt19937_64 rng(seed);
+    for (size_t i = 0; i < opts.block_size * opts.max_inflight / 8; i++) {
+        static_cast<uint64_t*>(buffers)[i] = rng();
+    }
+
+    std::cout << "target_iops,achieved_iops,mib_per_s,queue_p50_us,queue_p99_us,"
+              << "service_p50_us,service_p99_us,service_p999_us,"
+              << "total_p50_us,total_p99_us,total_p999_us,total_max_us,backlog,saturated"
+              << std::endl;
+
+    LoadResult result;
+    int ret = 0;
+    double target = single_iops > 0 ? single_iops : start_iops;
+    double last = single_iops > 0 ? single_iops : max_iops;
+    for (; target <= last; target *= step) {
+        std::cerr << "Target " << std::fixed << target << " IOPS..." << std::endl;
+        if (!runLoad(fd, device_size, opts, target, rng, static_cast<char*>(buffers),
+                     result)) {
+            ret = 1;
+            break;
+        }
+        // Saturated: the device no longer keeps up with the arrival rate, so
+        // queueing delay grows with the length of the run.
+        bool saturated = result.achieved_iops < 0.9 * target ||
+                         result.backlog > static_cast<int64_t>(result.total_us.size() / 100);
+        std::cout << std::fixed << target << "," << result.achieved_iops << ","
+                  << result.achieved_iops * opts.block_size / (1024 * 1024) << ","
+                  << percentile(result.queue_us, 0.5) << ","
+                  << percentile(result.queue_us, 0.99) << ","
+                  << percentile(result.service_us, 0.5) << ","
+                  << percentile(result.service_us, 0.99) << ","
+                  << percentile(result.service_us, 0.999) << ","
+                  << percentile(result.total_us, 0.5) << ","
+                  << percentile(result.total_us, 0.99) << ","
+                  << percentile(result.total_us, 0.999) << ","
+                  << (result.total_us.empty() ? 0.0 : result.total_us.back()) << ","
+                  << result.backlog << "," << saturated << std::endl;
+        if (saturated) {
+            std::cerr << "Saturated at " << result.achieved_iops << " IOPS" << std::endl;
+            break;
+        }
+    }
+
+    free(buffers);
+    close(fd);
+    return ret;
+}
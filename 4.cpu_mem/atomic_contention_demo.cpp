@@ -2,16 +2,32 @@
 //
 // This program demonstrates how cache coherency protocols impact performance
 // when multiple threads compete to update a shared variable.
-// Compares atomic operations vs mutex-protected operations.
+// Compares atomic operations, a CAS loop, several locks (std::mutex, TTAS
+// spinlock, ticket, MCS, futex) and flat combining guarding the same
+// counter, and a sharded counter that avoids the shared line altogether.
+// --placement keeps the threads on one NUMA node or spreads them across
+// nodes, to compare contention within and across sockets. Besides
+// throughput it reports fairness: how evenly the operations were spread over
+// the threads.
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
-#include <sys/resource.h>
+
+#include "benchmark_measurement.h"
+#include "cache_line.h"
+#include "locks.h"
+#include "numa_placement.h"
+#include "perf_counters.h"
+#include "sharded_counter.h"
 
 std::atomic<int64_t> global_counter{0};
 std::mutex counter_mutex;
@@ -19,61 +35,108 @@ int64_t mutex_counter = 0;
 
 const int64_t TARGET = 400000000LL;
 
-class BenchmarkMeasurement {
- public:
-  static void PrintHeader() {
-    std::cout << std::setw(12) << "Type" << std::setw(10) << "Threads"
-              << std::setw(15) << "Time (s)" << std::setw(12) << "CPU %"
-              << std::endl;
-    std::cout << std::string(49, '-') << std::endl;
-  }
+// Set by --perf; the measurements then also report hardware counters
+PerfCounters* perf_counters = nullptr;
 
-  void Start() {
-    getrusage(RUSAGE_SELF, &usage_start_);
-    start_ = std::chrono::high_resolution_clock::now();
-  }
+// Set by --placement: thread i runs on thread_cpus[i % size]; empty leaves
+// placement to the scheduler
+std::vector<int> thread_cpus;
 
-  void Stop() {
-    end_ = std::chrono::high_resolution_clock::now();
-    getrusage(RUSAGE_SELF, &usage_end_);
+// An unpinned thread would quietly measure the scheduler's placement
+// instead, so failures are reported (once, not per thread and run).
+void PlaceThread(int i) {
+  if (thread_cpus.empty()) {
+    return;
   }
+  int cpu = thread_cpus[i % thread_cpus.size()];
+  if (!PinToCpu(cpu)) {
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+      std::cerr << "Warning: cannot pin a thread to CPU " << cpu
+                << "; results reflect the scheduler's placement" << std::endl;
+    }
+  }
+}
 
-  void Print(const std::string& type, int num_threads) const {
-    std::chrono::duration<double> elapsed = end_ - start_;
-
-    double cpu_time = (usage_end_.ru_utime.tv_sec - usage_start_.ru_utime.tv_sec) +
-                      (usage_end_.ru_utime.tv_usec - usage_start_.ru_utime.tv_usec) / 1e6 +
-                      (usage_end_.ru_stime.tv_sec - usage_start_.ru_stime.tv_sec) +
-                      (usage_end_.ru_stime.tv_usec - usage_start_.ru_stime.tv_usec) / 1e6;
+// "same-node": the CPUs of the first node, so the counter's line only moves
+// between cores of one socket. "cross-node": alternating between nodes, so
+// consecutive threads sit on different sockets and every handoff crosses
+// the interconnect.
+bool PlacementCpus(const std::string& placement, std::vector<int>* cpus) {
+  std::vector<int> nodes = NumaNodes(true);
+  cpus->clear();
+  if (placement == "default") {
+    return true;
+  }
+  if (placement == "same-node") {
+    *cpus = NodeCpus(nodes[0]);
+    return true;
+  }
+  if (placement != "cross-node") {
+    return false;
+  }
+  std::vector<std::vector<int>> per_node;
+  size_t longest = 0;
+  for (int node : nodes) {
+    per_node.push_back(NodeCpus(node));
+    longest = std::max(longest, per_node.back().size());
+  }
+  for (size_t k = 0; k < longest; ++k) {
+    for (const std::vector<int>& node_cpus : per_node) {
+      if (k < node_cpus.size()) {
+        cpus->push_back(node_cpus[k]);
+      }
+    }
+  }
+  return true;
+}
 
-    double cpu_percent = (cpu_time / elapsed.count()) * 100.0;
+void PrintHeader() {
+  std::cout << std::setw(12) << "Type" << std::setw(10) << "Threads"
+            << std::setw(15) << "Time (s)" << std::setw(12) << "CPU %"
+            << std::setw(12) << "Mops/s" << std::setw(10) << "Jain"
+            << std::setw(16) << "Min/max share" << std::endl;
+  std::cout << std::string(87, '-') << std::endl;
+}
 
-    std::cout << std::setw(12) << type << std::setw(10) << num_threads
-              << std::setw(15) << std::fixed << std::setprecision(2)
-              << elapsed.count() << std::setw(11) << std::setprecision(1)
-              << cpu_percent << "%" << std::endl;
+// Fairness reads "-" for runs that split the work in advance
+void PrintRow(const std::string& type, int num_threads,
+              const BenchmarkMeasurement& measure) {
+  std::cout << std::setw(12) << type << std::setw(10) << num_threads
+            << std::setw(15) << std::fixed << std::setprecision(2)
+            << measure.seconds() << std::setw(11) << std::setprecision(1)
+            << measure.cpu_percent() << "%" << std::setw(12)
+            << measure.operations_per_second() / 1e6;
+  if (auto fairness = measure.fairness()) {
+    std::cout << std::setw(10) << std::setprecision(3) << fairness->jain
+              << std::setw(9) << std::setprecision(2) << fairness->min_share
+              << "/" << std::setw(6) << fairness->max_share;
+  } else {
+    std::cout << std::setw(10) << "-" << std::setw(16) << "-";
   }
+  std::cout << measure.CounterSummary() << std::endl;
+}
 
- private:
-  std::chrono::high_resolution_clock::time_point start_, end_;
-  struct rusage usage_start_, usage_end_;
-};
-
-BenchmarkMeasurement RunBenchmark(int num_threads) {
-  global_counter.store(0);
+// Every thread increments until the counter reaches the target; `increment`
+// returns the old value. Each thread also counts its own increments, in its
+// own cache line so the bookkeeping does not add contention.
+template <typename Increment>
+BenchmarkMeasurement RunCounterBenchmark(int num_threads, int64_t target,
+                                         Increment increment) {
+  PerThread<int64_t> ops(num_threads);
   std::vector<std::thread> threads;
 
-  BenchmarkMeasurement measure;
+  BenchmarkMeasurement measure(perf_counters);
   measure.Start();
 
   for (int i = 0; i < num_threads; ++i) {
-    threads.emplace_back([]() {
-      while (true) {
-        int64_t current = global_counter.fetch_add(1, std::memory_order_relaxed);
-        if (current >= TARGET) {
-          break;
-        }
+    threads.emplace_back([&ops, &increment, target, i]() {
+      PlaceThread(i);
+      int64_t mine = 0;
+      while (increment(i) < target) {
+        ++mine;
       }
+      ops[i] = mine;
     });
   }
 
@@ -82,27 +145,57 @@ BenchmarkMeasurement RunBenchmark(int num_threads) {
   }
 
   measure.Stop();
+  std::vector<int64_t> per_thread;
+  for (int i = 0; i < num_threads; ++i) {
+    per_thread.push_back(ops[i]);
+  }
+  measure.SetOperations(std::move(per_thread));
   return measure;
 }
 
-BenchmarkMeasurement RunBenchmarkMutex(int num_threads) {
+BenchmarkMeasurement RunBenchmark(int num_threads, int64_t target) {
+  global_counter.store(0);
+  return RunCounterBenchmark(num_threads, target, [](int) {
+    return global_counter.fetch_add(1, std::memory_order_relaxed);
+  });
+}
+
+BenchmarkMeasurement RunBenchmarkMutex(int num_threads, int64_t target) {
   mutex_counter = 0;
+  return RunCounterBenchmark(num_threads, target, [](int) {
+    std::lock_guard<std::mutex> lock(counter_mutex);
+    return mutex_counter++;
+  });
+}
+
+BenchmarkMeasurement RunBenchmarkCas(int num_threads, int64_t target) {
+  global_counter.store(0);
+  return RunCounterBenchmark(num_threads, target, [](int) {
+    int64_t current = global_counter.load(std::memory_order_relaxed);
+    while (!global_counter.compare_exchange_weak(current, current + 1,
+                                                 std::memory_order_relaxed)) {
+    }
+    return current;
+  });
+}
+
+// A sharded counter cannot hand out the old value, so each thread does an
+// equal share of the increments instead; the exact total is checked at the
+// end. With the split fixed up front there is no fairness to report.
+BenchmarkMeasurement RunBenchmarkSharded(int num_threads, int64_t target,
+                                         ShardedCounter::Mode mode) {
+  ShardedCounter counter(mode);
   std::vector<std::thread> threads;
 
-  BenchmarkMeasurement measure;
+  BenchmarkMeasurement measure(perf_counters);
   measure.Start();
 
   for (int i = 0; i < num_threads; ++i) {
-    threads.emplace_back([]() {
-      while (true) {
-        int64_t current;
-        {
-          std::lock_guard<std::mutex> lock(counter_mutex);
-          current = mutex_counter++;
-        }
-        if (current >= TARGET) {
-          break;
-        }
+    int64_t share = target / num_threads + (i < target % num_threads ? 1 : 0);
+    threads.emplace_back([&counter, share, i]() {
+      PlaceThread(i);
+      for (int64_t n = 0; n < share; ++n) {
+        counter.Add();
       }
     });
   }
@@ -112,17 +205,156 @@ BenchmarkMeasurement RunBenchmarkMutex(int num_threads) {
   }
 
   measure.Stop();
+  if (counter.Snapshot() != static_cast<uint64_t>(target)) {
+    std::cerr << "Sharded counter lost increments: " << counter.Snapshot()
+              << " != " << target << std::endl;
+  }
+  measure.SetTotalOperations(target);
   return measure;
 }
 
-int main() {
-  std::vector<int> thread_counts = {1, 2, 4};
+template <typename Lock>
+BenchmarkMeasurement RunLockBenchmark(int num_threads, int64_t target) {
+  Lock lock;
+  int64_t counter = 0;
+  return RunCounterBenchmark(num_threads, target, [&lock, &counter](int) {
+    std::lock_guard<Lock> guard(lock);
+    return counter++;
+  });
+}
 
-  BenchmarkMeasurement::PrintHeader();
+// Flat combining (Hendler et al.): a thread posts its request in its own
+// slot, and whichever thread grabs the combiner lock applies every pending
+// request in one pass. The counter and the lock stay in the combiner's cache
+// while the others wait on their own slots.
+class FlatCombiningCounter {
+ public:
+  explicit FlatCombiningCounter(int num_threads) : slots_(num_threads) {}
+
+  int64_t Increment(int thread) {
+    Slot& slot = slots_[thread];
+    slot.pending.store(true, std::memory_order_release);
+    SpinWait wait;
+    while (true) {
+      if (!combiner_.load(std::memory_order_relaxed) &&
+          !combiner_.exchange(true, std::memory_order_acquire)) {
+        for (Slot& s : slots_) {
+          if (s.pending.load(std::memory_order_acquire)) {
+            s.result = counter_++;
+            s.pending.store(false, std::memory_order_release);
+          }
+        }
+        combiner_.store(false, std::memory_order_release);
+      }
+      if (!slot.pending.load(std::memory_order_acquire)) {
+        return slot.result;
+      }
+      wait.Wait();
+    }
+  }
+
+ private:
+  struct alignas(64) Slot {
+    std::atomic<bool> pending{false};
+    int64_t result = 0;
+  };
+
+  std::vector<Slot> slots_;
+  alignas(64) std::atomic<bool> combiner_{false};
+  int64_t counter_ = 0;
+};
+
+void PrintUsage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [--ops N] [--max-threads N] [--perf]"
+            << " [--placement default|same-node|cross-node]" << std::endl;
+  std::cerr << "  --ops N          increments per run (default " << TARGET << ")"
+            << std::endl;
+  std::cerr << "  --max-threads N  largest thread count (default: all cores, at least 4)"
+            << std::endl;
+  std::cerr << "  --perf           add IPC and cache/TLB misses per operation" << std::endl;
+  std::cerr << "  --placement P    pin threads to one NUMA node or alternate between"
+            << " nodes (default: scheduler's choice)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int64_t target = TARGET;
+  bool perf = false;
+  std::string placement = "default";
+  const int cores = std::max(1u, std::thread::hardware_concurrency());
+  int max_threads = std::max(4, cores);
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--ops" && i + 1 < argc) {
+      target = std::stoll(argv[++i]);
+    } else if (arg == "--max-threads" && i + 1 < argc) {
+      max_threads = std::stoi(argv[++i]);
+    } else if (arg == "--perf") {
+      perf = true;
+    } else if (arg == "--placement" && i + 1 < argc) {
+      placement = argv[++i];
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (target <= 0 || max_threads <= 0 || !PlacementCpus(placement, &thread_cpus)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (placement != "default") {
+    std::cout << "NUMA node distances:" << std::endl;
+    PrintNodeDistances(std::cout);
+    if (placement == "cross-node" && NumaNodes(true).size() < 2) {
+      std::cout << "Only one node: cross-node is the same as same-node" << std::endl;
+    }
+    std::cout << std::endl;
+  }
+
+  // Powers of two up to all cores, plus the core count itself
+  std::vector<int> thread_counts;
+  for (int n = 1; n < max_threads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(max_threads);
+
+  std::unique_ptr<PerfCounters> counters;
+  if (perf) {
+    counters = std::make_unique<PerfCounters>();
+    if (!counters->Error().empty()) {
+      std::cerr << "Some perf counters are unavailable (" << counters->Error()
+                << "), printing n/a for them" << std::endl;
+    }
+    perf_counters = counters.get();
+  }
+
+  PrintHeader();
 
   for (int num_threads : thread_counts) {
-    RunBenchmark(num_threads).Print("Atomic", num_threads);
-    RunBenchmarkMutex(num_threads).Print("Mutex", num_threads);
+    PrintRow("Atomic", num_threads, RunBenchmark(num_threads, target));
+    PrintRow("Mutex", num_threads, RunBenchmarkMutex(num_threads, target));
+    PrintRow("CAS loop", num_threads, RunBenchmarkCas(num_threads, target));
+    PrintRow("TTAS", num_threads, RunLockBenchmark<TtasLock>(num_threads, target));
+    if (num_threads <= cores) {
+      PrintRow("Ticket", num_threads, RunLockBenchmark<TicketLock>(num_threads, target));
+      PrintRow("MCS", num_threads, RunLockBenchmark<McsLock>(num_threads, target));
+    } else {
+      // FIFO handoff goes to the next waiter even if it is not running, so
+      // every release waits for a context switch: thousands of times slower.
+      std::cout << std::setw(12) << "Ticket/MCS" << std::setw(10) << num_threads
+                << "   skipped: more threads than cores" << std::endl;
+    }
+    PrintRow("Futex", num_threads, RunLockBenchmark<FutexLock>(num_threads, target));
+
+    PrintRow("Shard/cpu", num_threads,
+             RunBenchmarkSharded(num_threads, target, ShardedCounter::Mode::kPerCpu));
+    PrintRow("Shard/thread", num_threads,
+             RunBenchmarkSharded(num_threads, target, ShardedCounter::Mode::kPerThread));
+
+    FlatCombiningCounter combining(num_threads);
+    PrintRow("Combining", num_threads,
+             RunCounterBenchmark(num_threads, target, [&combining](int thread) {
+               return combining.Increment(thread);
+             }));
   }
 
   return 0;
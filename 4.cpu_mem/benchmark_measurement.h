@@ -0,0 +1,146 @@
+// Benchmark measurement
+//
+// Wall time, process CPU time (getrusage) and, given PerfCounters, the
+// hardware counter deltas of one measured section, plus the operations it
+// completed for throughput, fairness and per-operation counts:
+//
+//   BenchmarkMeasurement measure(counters);  // null without --perf
+//   measure.Start();
+//   ... run and join the threads ...
+//   measure.Stop();
+//   measure.SetOperations(ops_per_thread);
+//   std::cout << measure.seconds() << measure.CounterSummary();
+//
+// CPU time and counters cover the whole process, so only one section may be
+// measured at a time.
+
+#ifndef CPU_MEM_BENCHMARK_MEASUREMENT_H_
+#define CPU_MEM_BENCHMARK_MEASUREMENT_H_
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.h"
+
+class BenchmarkMeasurement {
+ public:
+  // How evenly the operations were spread over the threads. Jain's index is
+  // 1 when every thread did the same amount of work and 1/n when one thread
+  // did all of it; the shares are the least and most busy thread's
+  // operations relative to an equal split.
+  struct Fairness {
+    double jain;
+    double min_share;
+    double max_share;
+  };
+
+  // `counters` must outlive the measurement; null measures time only.
+  explicit BenchmarkMeasurement(const PerfCounters* counters = nullptr)
+      : counters_(counters) {}
+
+  void Start() {
+    if (counters_) {
+      perf_start_ = counters_->Read();
+    }
+    getrusage(RUSAGE_SELF, &usage_start_);
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  void Stop() {
+    end_ = std::chrono::steady_clock::now();
+    getrusage(RUSAGE_SELF, &usage_end_);
+    if (counters_) {
+      perf_delta_ = PerfCounters::Delta(perf_start_, counters_->Read());
+    }
+  }
+
+  // Operations completed by each thread
+  void SetOperations(std::vector<int64_t> per_thread) {
+    per_thread_ = std::move(per_thread);
+    fairness_known_ = true;
+  }
+
+  // Only the total, for runs that split the work in advance: equal shares
+  // say nothing about fairness.
+  void SetTotalOperations(int64_t total) {
+    per_thread_ = {total};
+    fairness_known_ = false;
+  }
+
+  double seconds() const {
+    return std::chrono::duration<double>(end_ - start_).count();
+  }
+
+  // User plus system time of the whole process
+  double cpu_seconds() const { return CpuSeconds(usage_start_, usage_end_); }
+
+  // User plus system time between two getrusage() calls, e.g. of one thread
+  // with RUSAGE_THREAD
+  static double CpuSeconds(const struct rusage& start, const struct rusage& end) {
+    return (end.ru_utime.tv_sec - start.ru_utime.tv_sec) +
+           (end.ru_utime.tv_usec - start.ru_utime.tv_usec) / 1e6 +
+           (end.ru_stime.tv_sec - start.ru_stime.tv_sec) +
+           (end.ru_stime.tv_usec - start.ru_stime.tv_usec) / 1e6;
+  }
+
+  double cpu_percent() const {
+    return seconds() > 0 ? cpu_seconds() / seconds() * 100.0 : 0;
+  }
+
+  double operations() const {
+    double total = 0;
+    for (int64_t ops : per_thread_) {
+      total += ops;
+    }
+    return total;
+  }
+
+  double operations_per_second() const {
+    return seconds() > 0 ? operations() / seconds() : 0;
+  }
+
+  // Empty without per-thread counts
+  std::optional<Fairness> fairness() const {
+    if (!fairness_known_ || per_thread_.empty()) {
+      return std::nullopt;
+    }
+    double n = per_thread_.size();
+    double total = operations();
+    double sum_sq = 0;
+    for (int64_t ops : per_thread_) {
+      sum_sq += static_cast<double>(ops) * ops;
+    }
+    auto [lo, hi] = std::minmax_element(per_thread_.begin(), per_thread_.end());
+    double equal = total / n;
+    if (equal <= 0) {
+      return Fairness{1, 1, 1};
+    }
+    return Fairness{total * total / (n * sum_sq), *lo / equal, *hi / equal};
+  }
+
+  bool has_counters() const { return counters_ != nullptr; }
+  const PerfCounters::Sample& counter_delta() const { return perf_delta_; }
+
+  // PerfCounters::Summary() per operation; empty without counters
+  std::string CounterSummary() const {
+    return counters_ ? PerfCounters::Summary(perf_delta_, operations()) : "";
+  }
+
+ private:
+  const PerfCounters* counters_;
+  std::chrono::steady_clock::time_point start_, end_;
+  struct rusage usage_start_ = {}, usage_end_ = {};
+  std::vector<int64_t> per_thread_;
+  bool fairness_known_ = false;
+  PerfCounters::Sample perf_start_, perf_delta_;
+};
+
+#endif  // CPU_MEM_BENCHMARK_MEASUREMENT_H_
@@ -0,0 +1,68 @@
+// Cache-line padding helpers
+//
+// Two threads writing different variables that happen to share a cache line
+// still fight over the line (false sharing). Giving every thread's hot state
+// its own line avoids that:
+//
+//   PerThread<std::atomic<uint64_t>> hits(num_threads);
+//   hits[thread_id].fetch_add(1, std::memory_order_relaxed);
+//
+// Intel cores also prefetch the adjacent line of every 128-byte pair (the
+// "spatial prefetcher"), so writers 64 bytes apart can still interfere a
+// little; kFalseSharingRange covers that pair on x86-64.
+
+#ifndef CPU_MEM_CACHE_LINE_H_
+#define CPU_MEM_CACHE_LINE_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+#ifdef __cpp_lib_hardware_interference_size
+// GCC warns that the value depends on -mtune; it only sizes in-process data
+// here, never anything shared between binaries.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+inline constexpr size_t kDestructiveInterferenceSize =
+    std::hardware_destructive_interference_size;
+#pragma GCC diagnostic pop
+#else
+inline constexpr size_t kDestructiveInterferenceSize = 64;
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+inline constexpr size_t kFalseSharingRange = 2 * kDestructiveInterferenceSize;
+#else
+inline constexpr size_t kFalseSharingRange = kDestructiveInterferenceSize;
+#endif
+
+// A T that starts a line (pair) of its own and does not share it with the
+// next object; sizeof rounds up to the alignment.
+template <typename T, size_t Align = kFalseSharingRange>
+struct alignas(Align) CacheAligned {
+  T value{};
+
+  T& operator*() { return value; }
+  const T& operator*() const { return value; }
+  T* operator->() { return &value; }
+  const T* operator->() const { return &value; }
+};
+
+// Fixed-size array of per-thread slots, each CacheAligned
+template <typename T, size_t Align = kFalseSharingRange>
+class PerThread {
+ public:
+  explicit PerThread(size_t num_threads)
+      : size_(num_threads), slots_(new CacheAligned<T, Align>[num_threads]) {}
+
+  T& operator[](size_t thread) { return slots_[thread].value; }
+  const T& operator[](size_t thread) const { return slots_[thread].value; }
+
+  size_t size() const { return size_; }
+
+ private:
+  size_t size_;
+  std::unique_ptr<CacheAligned<T, Align>[]> slots_;
+};
+
+#endif  // CPU_MEM_CACHE_LINE_H_
@@ -5,24 +5,177 @@
 //
 // When data fits in cache (L1/L2/L3), access is fast.
 // When it exceeds cache, each access requires DRAM fetch.
+//
+// The driver sweeps the working set from a few KiB to a few GiB, prints a CSV
+// of ns/access per size and reports where the latency steps up (the "knees"),
+// next to the cache sizes the kernel reports in sysfs.
+//
+// On multi-socket machines --cpu-node / --mem-node pin the measurement and
+// its memory to given NUMA nodes, and --mode numa measures every pairing.
+// --perf adds hardware counters per access (IPC, cache and TLB misses) for
+// every size of the latency and TLB sweeps.
 
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <system_error>
 #include <vector>
 
+#include <linux/mman.h>
+#include <sys/mman.h>
+
+#include "benchmark_measurement.h"
+#include "numa_placement.h"
+#include "parse_size.h"
+#include "perf_counters.h"
+
+// Most independent chains RunChains() can follow at once
+constexpr int kMaxChains = 32;
+
 // Node structure with padding to fill cache line
 struct Node {
   Node* next;
   char padding[56];  // Together with next* gives 64 bytes (typical cache line)
 };
 
+// How the node array is backed. kDefault leaves the choice to the kernel's
+// THP policy; the others force small pages, ask for transparent huge pages,
+// or take pages from the hugetlbfs pool (reserved beforehand via
+// /proc/sys/vm/nr_hugepages or the hugepages= boot parameter).
+enum class PageMode { kDefault, kSmall, kTransparentHuge, kHuge2M, kHuge1G };
+
+bool ParsePageMode(const std::string& name, PageMode* mode) {
+  if (name == "default") *mode = PageMode::kDefault;
+  else if (name == "small") *mode = PageMode::kSmall;
+  else if (name == "thp") *mode = PageMode::kTransparentHuge;
+  else if (name == "2m") *mode = PageMode::kHuge2M;
+  else if (name == "1g") *mode = PageMode::kHuge1G;
+  else return false;
+  return true;
+}
+
+// Anonymous mapping for the nodes, aligned to the page size it asks for
+class NodeArena {
+ public:
+  NodeArena(size_t bytes, PageMode mode) {
+    constexpr size_t k2M = size_t{2} << 20;
+    constexpr size_t k1G = size_t{1} << 30;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t align = 4096;
+    if (mode == PageMode::kHuge2M) {
+      flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+      align = k2M;
+    } else if (mode == PageMode::kHuge1G) {
+      flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+      align = k1G;
+    } else if (mode != PageMode::kSmall) {
+      align = k2M;  // A THP can only back a 2 MiB-aligned range
+    }
+    bytes_ = (bytes + align - 1) / align * align;
+
+    // hugetlb mappings come aligned; for the rest over-allocate and trim
+    bool hugetlb = flags & MAP_HUGETLB;
+    map_bytes_ = hugetlb ? bytes_ : bytes_ + align;
+    map_ = mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (map_ == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(),
+                              hugetlb ? "mmap MAP_HUGETLB (are huge pages reserved?)"
+                                      : "mmap");
+    }
+    uintptr_t base = reinterpret_cast<uintptr_t>(map_);
+    base_ = reinterpret_cast<char*>((base + align - 1) / align * align);
+
+    if (mode == PageMode::kSmall) {
+      madvise(base_, bytes_, MADV_NOHUGEPAGE);
+    } else if (mode == PageMode::kTransparentHuge) {
+      madvise(base_, bytes_, MADV_HUGEPAGE);
+    }
+  }
+
+  ~NodeArena() { munmap(map_, map_bytes_); }
+
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+
+  char* data() const { return base_; }
+  size_t size() const { return bytes_; }
+
+ private:
+  void* map_;
+  size_t map_bytes_;
+  char* base_;
+  size_t bytes_;
+};
+
+// What actually backs [addr, addr + bytes), from /proc/self/smaps: the
+// kernel page size of the mapping and, for THP, how much of it is huge.
+std::string DescribePages(const void* addr) {
+  std::ifstream smaps("/proc/self/smaps");
+  uintptr_t target = reinterpret_cast<uintptr_t>(addr);
+  std::string line;
+  bool in_mapping = false;
+  size_t size_kb = 0, page_kb = 0, anon_huge_kb = 0;
+  while (std::getline(smaps, line)) {
+    uintptr_t lo, hi;
+    char dash;
+    std::istringstream fields(line);
+    if (line.find(':') == std::string::npos || line.find('-') < line.find(':')) {
+      // Header line of a mapping: "lo-hi perms ..."
+      if (fields >> std::hex >> lo >> dash >> hi && dash == '-') {
+        if (in_mapping) {
+          break;
+        }
+        in_mapping = target >= lo && target < hi;
+      }
+      continue;
+    }
+    if (!in_mapping) {
+      continue;
+    }
+    std::string key;
+    size_t value;
+    fields >> key >> value;
+    if (key == "Size:") size_kb = value;
+    if (key == "KernelPageSize:") page_kb = value;
+    if (key == "AnonHugePages:") anon_huge_kb = value;
+  }
+  if (page_kb >= 1024 * 1024) {
+    return "1G";
+  }
+  if (page_kb >= 2048) {
+    return "2M";
+  }
+  if (anon_huge_kb > 0 && size_kb > 0) {
+    std::ostringstream out;
+    out << "2M THP " << anon_huge_kb * 100 / size_kb << "%";
+    return out.str();
+  }
+  return "4K";
+}
+
 class CacheSizeDemo {
  public:
-  explicit CacheSizeDemo(size_t num_nodes) : nodes_(num_nodes) {
+  // Nodes are `stride` bytes apart. A stride of a page places one node per
+  // page, at a different line in each so that they do not all compete for
+  // the same cache sets: the lines fit in cache long after the pages stop
+  // fitting in the TLB, which isolates the cost of TLB misses.
+  explicit CacheSizeDemo(size_t num_nodes, uint64_t seed = std::random_device()(),
+                         PageMode pages = PageMode::kDefault,
+                         size_t stride = sizeof(Node))
+      : arena_(num_nodes * stride, pages), stride_(stride) {
     // Create random cycle through all nodes
     std::vector<size_t> indices(num_nodes);
     for (size_t i = 0; i < num_nodes; ++i) {
@@ -30,20 +183,27 @@ class CacheSizeDemo {
     }
 
     // Shuffle for random access pattern
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937_64 gen(seed);
     std::shuffle(indices.begin(), indices.end(), gen);
 
     // Connect nodes in a cycle
     for (size_t i = 0; i < num_nodes; ++i) {
       size_t next_idx = (i + 1) % num_nodes;
-      nodes_[indices[i]].next = &nodes_[indices[next_idx]];
+      NodeAt(indices[i])->next = NodeAt(indices[next_idx]);
+    }
+
+    // Starting points for k chains, evenly spaced along the cycle so they
+    // never catch up with each other
+    for (int k = 1; k <= kMaxChains; ++k) {
+      for (int j = 0; j < k; ++j) {
+        chain_starts_[k].push_back(NodeAt(indices[j * num_nodes / k]));
+      }
     }
   }
 
   // Run test - traverse list N times
   double RunTest(size_t iterations) {
-    Node* current = &nodes_[0];
+    Node* current = NodeAt(0);
 
     auto start = std::chrono::high_resolution_clock::now();
 
@@ -61,12 +221,806 @@ class CacheSizeDemo {
     return elapsed.count() / iterations;  // Nanoseconds per access
   }
 
+  // Follows `chains` independent pointer chains in lockstep, `iterations`
+  // accesses in total. Each chain is still a dependent sequence of misses,
+  // but the misses of different chains can overlap, so the time per access
+  // drops until the core runs out of miss-handling (line fill) buffers.
+  double RunChains(size_t iterations, int chains) {
+    static const auto kRunners = MakeChainRunners(std::make_integer_sequence<int, kMaxChains>());
+    return kRunners[chains - 1](this, iterations);
+  }
+
+  // Page size the kernel actually used for the nodes
+  std::string PageSize() const { return DescribePages(arena_.data()); }
+
+ private:
+  // With a stride above one line, the line within the stride varies with
+  // both the low index bits (the L1 set is picked by the line alone) and the
+  // bits above the low 5 (on physically contiguous huge pages those pick the
+  // L2 set together with the line). Otherwise nodes crowd into a few sets.
+  Node* NodeAt(size_t i) const {
+    size_t line = stride_ > sizeof(Node) ? (i + (i >> 5)) % (stride_ / sizeof(Node)) : 0;
+    return reinterpret_cast<Node*>(arena_.data() + i * stride_ + line * sizeof(Node));
+  }
+
+  using ChainRunner = double (*)(CacheSizeDemo*, size_t);
+
+  template <int... Ks>
+  static std::array<ChainRunner, kMaxChains> MakeChainRunners(
+      std::integer_sequence<int, Ks...>) {
+    return {&CacheSizeDemo::RunChainsFixed<Ks + 1>...};
+  }
+
+  // K is a template parameter so the chain heads can live in registers and
+  // the inner loop is fully unrolled.
+  template <int K>
+  static double RunChainsFixed(CacheSizeDemo* demo, size_t iterations) {
+    std::array<Node*, K> current;
+    for (int k = 0; k < K; ++k) {
+      current[k] = demo->chain_starts_[K][k];
+    }
+    size_t rounds = std::max<size_t>(iterations / K, 1);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < rounds; ++i) {
+      for (int k = 0; k < K; ++k) {
+        current[k] = current[k]->next;
+      }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < K; ++k) {
+      if (current[k] == nullptr) {
+        std::cout << "whatever, just make the compiler not optimize this out"
+                  << std::endl;
+      }
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / (rounds * K);  // Nanoseconds per access
+  }
+
+  NodeArena arena_;
+  size_t stride_;
+  std::array<std::vector<Node*>, kMaxChains + 1> chain_starts_;
+};
+
+// The same logical sequence (a random permutation of `num_elements`
+// elements) laid out in different ways, to compare what a traversal costs
+// per element:
+//
+//   padded   - one 64-byte Node per element, as in CacheSizeDemo
+//   compact  - 8-byte nodes holding just the next pointer, 8 per line
+//   soa      - a separate array of 32-bit next indices, 16 per line
+//   unrolled - B-tree-leaf style: 7 consecutive elements share a 64-byte
+//              node with the link to the next one, so one miss per 7
+//   prefetch - padded nodes that also point `prefetch_distance` elements
+//              ahead; the traversal prefetches that node while it walks
+//
+// Each layout is built and measured on its own so the largest sizes fit in
+// memory.
+class LayoutDemo {
+ public:
+  enum class Layout { kPadded, kCompact, kSoa, kUnrolled, kPrefetch };
+  static constexpr Layout kLayouts[] = {Layout::kPadded, Layout::kCompact, Layout::kSoa,
+                                        Layout::kUnrolled, Layout::kPrefetch};
+
+  static const char* Name(Layout layout) {
+    switch (layout) {
+      case Layout::kPadded: return "padded";
+      case Layout::kCompact: return "compact";
+      case Layout::kSoa: return "soa";
+      case Layout::kUnrolled: return "unrolled";
+      case Layout::kPrefetch: return "prefetch";
+    }
+    return "?";
+  }
+
+  LayoutDemo(size_t num_elements, uint64_t seed, PageMode pages, size_t prefetch_distance)
+      : num_elements_(num_elements), pages_(pages), seed_(seed),
+        prefetch_distance_(prefetch_distance), order_(num_elements) {
+    for (size_t i = 0; i < num_elements; ++i) {
+      order_[i] = static_cast<uint32_t>(i);
+    }
+    std::mt19937_64 gen(seed);
+    std::shuffle(order_.begin(), order_.end(), gen);
+  }
+
+  // Median ns/element over `repeats` traversals of `iterations` elements,
+  // after one warm-up traversal
+  double Measure(Layout layout, size_t iterations, int repeats) {
+    switch (layout) {
+      case Layout::kPadded: return MeasurePadded(iterations, repeats, false);
+      case Layout::kCompact: return MeasureCompact(iterations, repeats);
+      case Layout::kSoa: return MeasureSoa(iterations, repeats);
+      case Layout::kUnrolled: return MeasureUnrolled(iterations, repeats);
+      case Layout::kPrefetch: return MeasurePadded(iterations, repeats, true);
+    }
+    return 0;
+  }
+
  private:
-  std::vector<Node> nodes_;
+  struct PrefetchNode {
+    PrefetchNode* next;
+    PrefetchNode* ahead;
+    char padding[48];
+  };
+
+  struct CompactNode {
+    CompactNode* next;
+  };
+
+  struct Leaf {
+    static constexpr int kElements = 7;
+    Leaf* next;
+    uint64_t elements[kElements];
+  };
+
+  static_assert(sizeof(PrefetchNode) == 64 && sizeof(Leaf) == 64,
+                "padded layouts must fill a cache line");
+
+  // Runs `traverse(iterations)` (returns a value to keep the loop alive) and
+  // returns the median time per element.
+  template <typename Traverse>
+  static double Time(Traverse traverse, size_t iterations, int repeats) {
+    traverse(std::min<size_t>(iterations, 1 << 20));
+    std::vector<double> samples;
+    uintptr_t sink = 0;
+    for (int r = 0; r < repeats; ++r) {
+      auto start = std::chrono::high_resolution_clock::now();
+      sink ^= traverse(iterations);
+      auto end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::nano> elapsed = end - start;
+      samples.push_back(elapsed.count() / iterations);
+    }
+    if (sink == 1) {
+      std::cout << "whatever, just make the compiler not optimize this out"
+                << std::endl;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+  }
+
+  // Element at position i of the sequence, wrapping around
+  size_t At(size_t i) const { return order_[i % num_elements_]; }
+
+  // The prefetch variant is the padded one with the lookahead pointer filled
+  // in and prefetched; without it the two are identical.
+  double MeasurePadded(size_t iterations, int repeats, bool prefetch) {
+    NodeArena arena(num_elements_ * sizeof(PrefetchNode), pages_);
+    auto* nodes = reinterpret_cast<PrefetchNode*>(arena.data());
+    for (size_t i = 0; i < num_elements_; ++i) {
+      nodes[At(i)].next = &nodes[At(i + 1)];
+      nodes[At(i)].ahead = &nodes[At(i + prefetch_distance_)];
+    }
+    PrefetchNode* head = &nodes[At(0)];
+    if (!prefetch) {
+      return Time([head](size_t n) {
+        PrefetchNode* p = head;
+        for (size_t i = 0; i < n; ++i) {
+          p = p->next;
+        }
+        return reinterpret_cast<uintptr_t>(p);
+      }, iterations, repeats);
+    }
+    return Time([head](size_t n) {
+      PrefetchNode* p = head;
+      for (size_t i = 0; i < n; ++i) {
+        __builtin_prefetch(p->ahead);
+        p = p->next;
+      }
+      return reinterpret_cast<uintptr_t>(p);
+    }, iterations, repeats);
+  }
+
+  double MeasureCompact(size_t iterations, int repeats) {
+    NodeArena arena(num_elements_ * sizeof(CompactNode), pages_);
+    auto* nodes = reinterpret_cast<CompactNode*>(arena.data());
+    for (size_t i = 0; i < num_elements_; ++i) {
+      nodes[At(i)].next = &nodes[At(i + 1)];
+    }
+    CompactNode* head = &nodes[At(0)];
+    return Time([head](size_t n) {
+      CompactNode* p = head;
+      for (size_t i = 0; i < n; ++i) {
+        p = p->next;
+      }
+      return reinterpret_cast<uintptr_t>(p);
+    }, iterations, repeats);
+  }
+
+  double MeasureSoa(size_t iterations, int repeats) {
+    NodeArena arena(num_elements_ * sizeof(uint32_t), pages_);
+    auto* next = reinterpret_cast<uint32_t*>(arena.data());
+    for (size_t i = 0; i < num_elements_; ++i) {
+      next[At(i)] = static_cast<uint32_t>(At(i + 1));
+    }
+    uint32_t head = static_cast<uint32_t>(At(0));
+    return Time([next, head](size_t n) {
+      uint32_t e = head;
+      for (size_t i = 0; i < n; ++i) {
+        e = next[e];
+      }
+      return static_cast<uintptr_t>(e);
+    }, iterations, repeats);
+  }
+
+  // Leaves are placed in random order; inside a leaf the elements are the
+  // next 7 of the sequence.
+  double MeasureUnrolled(size_t iterations, int repeats) {
+    size_t num_leaves = std::max<size_t>(
+        (num_elements_ + Leaf::kElements - 1) / Leaf::kElements, 2);
+    std::vector<size_t> slots(num_leaves);
+    for (size_t i = 0; i < num_leaves; ++i) {
+      slots[i] = i;
+    }
+    std::mt19937_64 gen(seed_ + 1);
+    std::shuffle(slots.begin(), slots.end(), gen);
+
+    NodeArena arena(num_leaves * sizeof(Leaf), pages_);
+    auto* leaves = reinterpret_cast<Leaf*>(arena.data());
+    for (size_t l = 0; l < num_leaves; ++l) {
+      Leaf& leaf = leaves[slots[l]];
+      leaf.next = &leaves[slots[(l + 1) % num_leaves]];
+      for (int j = 0; j < Leaf::kElements; ++j) {
+        leaf.elements[j] = At(l * Leaf::kElements + j);
+      }
+    }
+    Leaf* head = &leaves[slots[0]];
+    return Time([head](size_t n) {
+      Leaf* p = head;
+      uint64_t sum = 0;
+      for (size_t i = 0; i < n; i += Leaf::kElements) {
+        for (int j = 0; j < Leaf::kElements; ++j) {
+          sum += p->elements[j];
+        }
+        p = p->next;
+      }
+      return reinterpret_cast<uintptr_t>(p) + sum;
+    }, iterations, repeats);
+  }
+
+  size_t num_elements_;
+  PageMode pages_;
+  uint64_t seed_;
+  size_t prefetch_distance_;
+  std::vector<uint32_t> order_;
+};
+
+struct SweepOptions {
+  size_t min_bytes = 4 << 10;
+  size_t max_bytes = size_t{2} << 30;
+  int repeats = 7;
+  size_t accesses = 4 << 20;  // Per repeat
+  uint64_t seed = 1;
+  size_t mlp_bytes = size_t{1} << 30;  // Working set of the MLP sweep
+  PageMode pages = PageMode::kDefault;
+  size_t prefetch_distance = 8;  // Elements ahead, for --mode layout
+  const PerfCounters* perf = nullptr;  // Set by --perf
+};
+
+struct SweepPoint {
+  size_t bytes;
+  double median_ns;
+  double min_ns;
+  double mean_ns;  // Mean of the repeats that were not rejected
+  int rejected;
+  std::string page_size;
+  std::string counters;  // Per access over all repeats; empty without --perf
 };
 
+// Times `opts.repeats` traversals of one working set. Repeats further than
+// 3 median absolute deviations from the median (preemption, frequency
+// changes, a neighbour thrashing the cache) are rejected from the mean.
+SweepPoint MeasurePoint(size_t bytes, const SweepOptions& opts,
+                        size_t stride = sizeof(Node)) {
+  size_t num_nodes = std::max<size_t>(bytes / stride, 2);
+  CacheSizeDemo demo(num_nodes, opts.seed, opts.pages, stride);
+  // Warm up: bring the working set into whatever cache holds it
+  demo.RunTest(std::min(num_nodes, opts.accesses));
 
-int main() {
+  BenchmarkMeasurement measure(opts.perf);
+  measure.Start();
+  std::vector<double> samples;
+  for (int r = 0; r < opts.repeats; ++r) {
+    samples.push_back(demo.RunTest(opts.accesses));
+  }
+  measure.Stop();
+  measure.SetTotalOperations(static_cast<int64_t>(opts.accesses) * opts.repeats);
+  std::sort(samples.begin(), samples.end());
+  double median = samples[samples.size() / 2];
+
+  std::vector<double> deviations;
+  for (double s : samples) {
+    deviations.push_back(std::fabs(s - median));
+  }
+  std::sort(deviations.begin(), deviations.end());
+  double mad = deviations[deviations.size() / 2];
+
+  double sum = 0;
+  int kept = 0;
+  for (double s : samples) {
+    if (std::fabs(s - median) <= 3 * mad + 1e-9) {
+      sum += s;
+      ++kept;
+    }
+  }
+  return SweepPoint{bytes, median, samples.front(), sum / kept,
+                    static_cast<int>(samples.size()) - kept, demo.PageSize(),
+                    measure.CounterSummary()};
+}
+
+// Powers of two plus the midpoints 1.5 * 2^k, for finer knee placement
+std::vector<size_t> SweepSizes(const SweepOptions& opts) {
+  std::vector<size_t> sizes;
+  for (size_t size = opts.min_bytes; size <= opts.max_bytes; size *= 2) {
+    sizes.push_back(size);
+    if (size + size / 2 <= opts.max_bytes) {
+      sizes.push_back(size + size / 2);
+    }
+  }
+  return sizes;
+}
+
+// A climb is where latency ends up more than 50% above the current plateau.
+// It can span several points, starting gently (e.g. as TLB misses add up
+// inside a cache level) and going on past the capacity, since random
+// accesses to a working set W above a cache of size C still hit with
+// probability C/W. So a climb is extended backwards and forwards while each
+// point is more than 10% above the previous one, and the knee is the first
+// point at least halfway up it in latency, which lands near C to 2C rather
+// than wherever the gentle part began.
+std::vector<size_t> DetectKnees(const std::vector<SweepPoint>& points) {
+  const double kRise = 1.5;
+  const double kStillRising = 1.1;
+  std::vector<size_t> knees;
+  if (points.empty()) {
+    return knees;
+  }
+  auto rising = [&points, kStillRising](size_t i) {
+    return points[i].median_ns > kStillRising * points[i - 1].median_ns;
+  };
+  double plateau = points[0].median_ns;
+  size_t previous_end = 0;
+  for (size_t i = 1; i < points.size(); ++i) {
+    if (points[i].median_ns > kRise * plateau) {
+      size_t start = i - 1;
+      while (start > previous_end && rising(start)) {
+        --start;
+      }
+      while (i + 1 < points.size() && rising(i + 1)) {
+        ++i;
+      }
+      double halfway = (points[start].median_ns + points[i].median_ns) / 2;
+      size_t knee = start + 1;
+      while (points[knee].median_ns < halfway) {
+        ++knee;
+      }
+      knees.push_back(points[knee].bytes);
+      plateau = points[i].median_ns;
+      previous_end = i;
+    } else {
+      plateau = std::min(plateau, points[i].median_ns);
+    }
+  }
+  return knees;
+}
+
+struct CacheLevel {
+  int level;
+  std::string type;
+  size_t bytes;
+};
+
+// Data and unified caches of cpu0, from the kernel's cacheinfo
+std::vector<CacheLevel> ReadSysfsCaches() {
+  std::vector<CacheLevel> levels;
+  for (int index = 0;; ++index) {
+    std::string dir =
+        "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+    std::ifstream level_file(dir + "level");
+    std::ifstream type_file(dir + "type");
+    std::ifstream size_file(dir + "size");
+    CacheLevel level;
+    std::string size;
+    if (!(level_file >> level.level) || !(type_file >> level.type) ||
+        !(size_file >> size)) {
+      break;
+    }
+    if (level.type == "Instruction") {
+      continue;
+    }
+    level.bytes = std::stoull(size);
+    if (size.back() == 'K') level.bytes <<= 10;
+    if (size.back() == 'M') level.bytes <<= 20;
+    levels.push_back(level);
+  }
+  return levels;
+}
+
+std::string FormatBytes(size_t bytes) {
+  const char* units[] = {"B", "KiB", "MiB", "GiB"};
+  int unit = 0;
+  double value = static_cast<double>(bytes);
+  while (value >= 1024 && unit < 3) {
+    value /= 1024;
+    ++unit;
+  }
+  std::ostringstream out;
+  out << std::setprecision(value < 10 ? 2 : 4) << value << " " << units[unit];
+  return out.str();
+}
+
+// Latency of a single chain for every working-set size, with cache knees
+int RunLatencySweep(const SweepOptions& opts) {
+  std::vector<SweepPoint> points;
+  std::cout << "size_bytes,median_ns,min_ns,mean_ns,rejected,page_size" << std::endl;
+  for (size_t bytes : SweepSizes(opts)) {
+    SweepPoint point = MeasurePoint(bytes, opts);
+    points.push_back(point);
+    std::cout << point.bytes << "," << std::fixed << std::setprecision(3)
+              << point.median_ns << "," << point.min_ns << "," << point.mean_ns
+              << "," << point.rejected << "," << point.page_size << std::endl;
+    if (opts.perf) {
+      std::cerr << FormatBytes(point.bytes) << ":" << point.counters << std::endl;
+    }
+  }
+
+  // Each knee is matched to the sysfs cache nearest in size, if one is
+  // within 2x; a cache claimed by two knees goes to the closer one. Other
+  // knees are usually TLB reach running out (or noise); caches without a
+  // knee are past --max-size, shared with other cores or barely slower than
+  // the level below.
+  std::vector<size_t> knees = DetectKnees(points);
+  std::vector<CacheLevel> caches = ReadSysfsCaches();
+  auto distance = [](size_t a, size_t b) {
+    return std::fabs(std::log2(static_cast<double>(a) / b));
+  };
+  std::vector<int> match(knees.size(), -1);
+  for (size_t k = 0; k < knees.size(); ++k) {
+    for (size_t c = 0; c < caches.size(); ++c) {
+      double d = distance(knees[k], caches[c].bytes);
+      if (d <= 1 && (match[k] < 0 || d < distance(knees[k], caches[match[k]].bytes))) {
+        match[k] = static_cast<int>(c);
+      }
+    }
+  }
+  for (size_t k = 0; k < knees.size(); ++k) {
+    for (size_t other = 0; other < knees.size(); ++other) {
+      if (other != k && match[k] >= 0 && match[other] == match[k] &&
+          distance(knees[other], caches[match[k]].bytes) <
+              distance(knees[k], caches[match[k]].bytes)) {
+        match[k] = -1;
+      }
+    }
+  }
+
+  std::cerr << "Detected knees:" << std::endl;
+  std::vector<bool> matched(caches.size(), false);
+  for (size_t k = 0; k < knees.size(); ++k) {
+    std::cerr << "  ~" << FormatBytes(knees[k]) << ": ";
+    if (match[k] >= 0) {
+      const CacheLevel& cache = caches[match[k]];
+      matched[match[k]] = true;
+      std::cerr << "sysfs L" << cache.level << " " << cache.type << " ("
+                << FormatBytes(cache.bytes) << ")";
+    } else {
+      std::cerr << "no sysfs cache within 2x (TLB reach or unknown)";
+    }
+    std::cerr << std::endl;
+  }
+  for (size_t c = 0; c < caches.size(); ++c) {
+    if (matched[c]) {
+      continue;
+    }
+    std::cerr << "  sysfs L" << caches[c].level << " " << caches[c].type << " ("
+              << FormatBytes(caches[c].bytes) << ") has no knee; ";
+    if (points.empty() || caches[c].bytes > points.back().bytes) {
+      std::cerr << "raise --max-size";
+    } else {
+      std::cerr << "the level may be shared with other cores, or the latency"
+                << " rises too little or too gradually across it";
+    }
+    std::cerr << std::endl;
+  }
+  if (!points.empty()) {
+    std::cerr << "  Largest working set (" << FormatBytes(points.back().bytes)
+              << "): " << std::fixed << std::setprecision(1) << points.back().median_ns
+              << " ns/access" << std::endl;
+  }
+
+  return 0;
+}
+
+// Memory-level parallelism: K = 1..kMaxChains chains over one working set
+// far larger than the caches. Throughput grows with K while the extra misses
+// can still be overlapped; where it levels off is the number of misses the
+// core keeps in flight, i.e. how wide a batch of independent lookups should
+// be.
+int RunMlpSweep(const SweepOptions& opts) {
+  size_t num_nodes = std::max<size_t>(opts.mlp_bytes / sizeof(Node), kMaxChains);
+  CacheSizeDemo demo(num_nodes, opts.seed, opts.pages);
+  demo.RunTest(std::min(num_nodes, opts.accesses));
+  std::cerr << "Working set backed by " << demo.PageSize() << " pages" << std::endl;
+
+  std::cout << "size_bytes,chains,ns_per_access,accesses_per_ns,speedup" << std::endl;
+  double single = 0;
+  double best = 0;
+  int saturation = 1;
+  for (int chains = 1; chains <= kMaxChains; ++chains) {
+    std::vector<double> samples;
+    for (int r = 0; r < opts.repeats; ++r) {
+      samples.push_back(demo.RunChains(opts.accesses, chains));
+    }
+    std::sort(samples.begin(), samples.end());
+    double ns = samples[samples.size() / 2];
+    double rate = 1 / ns;
+    if (chains == 1) {
+      single = rate;
+    }
+    // Saturated once another chain adds less than 5% over the best so far
+    if (rate > best * 1.05) {
+      saturation = chains;
+    }
+    best = std::max(best, rate);
+    std::cout << opts.mlp_bytes << "," << chains << "," << std::fixed
+              << std::setprecision(3) << ns << "," << std::setprecision(4) << rate
+              << "," << std::setprecision(2) << rate / single << std::endl;
+  }
+  std::cerr << "Throughput levels off at ~" << saturation << " chains ("
+            << std::fixed << std::setprecision(1) << best / single
+            << "x a single chain)" << std::endl;
+  return 0;
+}
 
+// TLB reach: one node per 4 KiB page, swept over the same address spans as
+// the latency sweep. The touched lines take only 1/64 of the span, so while
+// they fit in L2 the rise in latency comes from page walks alone. Running it
+// with --pages small and --pages thp (or 2m) shows what huge pages save.
+int RunTlbSweep(const SweepOptions& opts) {
+  constexpr size_t kPage = 4096;
+  std::cout << "span_bytes,pages,line_bytes,median_ns,min_ns,page_size" << std::endl;
+  for (size_t bytes : SweepSizes(opts)) {
+    if (bytes < 2 * kPage) {
+      continue;
+    }
+    SweepPoint point = MeasurePoint(bytes, opts, kPage);
+    size_t pages = bytes / kPage;
+    std::cout << bytes << "," << pages << "," << pages * sizeof(Node) << ","
+              << std::fixed << std::setprecision(3) << point.median_ns << ","
+              << point.min_ns << "," << point.page_size << std::endl;
+    if (opts.perf) {
+      std::cerr << FormatBytes(bytes) << ":" << point.counters << std::endl;
+    }
+  }
+  return 0;
+}
+
+// ns/element of every LayoutDemo layout for each working-set size. The
+// size is that of the padded layout (64 bytes per element); the others hold
+// the same elements in less memory.
+int RunLayoutSweep(const SweepOptions& opts) {
+  std::cout << "size_bytes,elements";
+  for (LayoutDemo::Layout layout : LayoutDemo::kLayouts) {
+    std::cout << "," << LayoutDemo::Name(layout) << "_ns";
+  }
+  std::cout << std::endl;
+  for (size_t bytes : SweepSizes(opts)) {
+    size_t elements = std::max<size_t>(bytes / sizeof(Node), 2);
+    if (elements > UINT32_MAX) {
+      break;  // The soa layout uses 32-bit indices
+    }
+    LayoutDemo demo(elements, opts.seed, opts.pages, opts.prefetch_distance);
+    std::cout << bytes << "," << elements;
+    for (LayoutDemo::Layout layout : LayoutDemo::kLayouts) {
+      std::cout << "," << std::fixed << std::setprecision(3)
+                << demo.Measure(layout, opts.accesses, opts.repeats);
+    }
+    std::cout << std::endl;
+  }
   return 0;
 }
+
+// DRAM latency (over --mlp-size bytes) from the CPUs of every node to the
+// memory of every node, and to memory interleaved over all of them. The
+// kernel's distance matrix goes to stderr for comparison. With a single node
+// this is one local and one "interleaved" row, which should match.
+int RunNumaMatrix(const SweepOptions& opts) {
+  std::vector<int> cpu_nodes = NumaNodes(true);
+  std::vector<int> mem_nodes = NumaNodes();
+  std::cout << "cpu_node,mem_node,ns_per_access,relative_to_local,page_size"
+            << std::endl;
+  for (int cpu_node : cpu_nodes) {
+    if (!BindThreadToNode(cpu_node)) {
+      throw std::system_error(errno, std::generic_category(), "sched_setaffinity");
+    }
+    // -1 stands for interleaved
+    std::vector<int> targets = {cpu_node};
+    for (int mem_node : mem_nodes) {
+      if (mem_node != cpu_node) {
+        targets.push_back(mem_node);
+      }
+    }
+    targets.push_back(-1);
+
+    double local_ns = 0;
+    for (int target : targets) {
+      bool placed = target < 0 ? SetMemoryPolicy(MPOL_INTERLEAVE, mem_nodes)
+                               : SetMemoryPolicy(MPOL_BIND, {target});
+      if (!placed) {
+        throw std::system_error(errno, std::generic_category(), "set_mempolicy");
+      }
+      SweepPoint point = MeasurePoint(opts.mlp_bytes, opts);
+      SetMemoryPolicy(MPOL_DEFAULT, {});
+      if (target == cpu_node) {
+        local_ns = point.median_ns;
+      }
+      std::cout << cpu_node << ","
+                << (target < 0 ? std::string("interleave") : std::to_string(target))
+                << "," << std::fixed << std::setprecision(3) << point.median_ns << ","
+                << std::setprecision(2) << point.median_ns / local_ns << ","
+                << point.page_size << std::endl;
+    }
+  }
+  std::cerr << "Kernel node distances:" << std::endl;
+  PrintNodeDistances(std::cerr);
+  return 0;
+}
+
+// --mem-node: empty, "interleave" or a node that has memory
+bool ValidMemNode(const std::string& mem_node) {
+  if (mem_node.empty() || mem_node == "interleave") {
+    return true;
+  }
+  if (mem_node.size() > 9 ||
+      mem_node.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  std::vector<int> nodes = NumaNodes();
+  return std::find(nodes.begin(), nodes.end(), std::stoi(mem_node)) != nodes.end();
+}
+
+// Applies --cpu-node / --mem-node to the main thread, which runs every
+// measurement; memory placement takes effect for the arenas allocated from
+// now on. mem_node has passed ValidMemNode().
+void ApplyPlacement(int cpu_node, const std::string& mem_node) {
+  if (cpu_node >= 0 && !BindThreadToNode(cpu_node)) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot run on node " + std::to_string(cpu_node));
+  }
+  if (mem_node.empty()) {
+    return;
+  }
+  bool placed = mem_node == "interleave"
+                    ? SetMemoryPolicy(MPOL_INTERLEAVE, NumaNodes())
+                    : SetMemoryPolicy(MPOL_BIND, {std::stoi(mem_node)});
+  if (!placed) {
+    throw std::system_error(errno, std::generic_category(), "set_mempolicy");
+  }
+}
+
+void PrintUsage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [--mode latency|mlp|tlb|layout|numa] [--min-size 4K]"
+            << " [--max-size 2G] [--mlp-size 1G] [--repeats 7] [--accesses N]"
+            << " [--seed N] [--pages default|small|thp|2m|1g] [--prefetch-distance 8]"
+            << " [--cpu-node N] [--mem-node N|interleave] [--perf]" << std::endl;
+  std::cerr << "latency: CSV size_bytes,median_ns,min_ns,mean_ns,rejected on stdout"
+            << " and the detected cache knees on stderr." << std::endl;
+  std::cerr << "mlp:     CSV of ns/access and accesses/ns for 1.." << kMaxChains
+            << " independent chains over --mlp-size bytes." << std::endl;
+  std::cerr << "tlb:     CSV of ns/access with one node per 4 KiB page, by address span."
+            << std::endl;
+  std::cerr << "layout:  CSV of ns/element for padded, compact, soa, unrolled and"
+            << " prefetch layouts, by size." << std::endl;
+  std::cerr << "numa:    CSV of ns/access over --mlp-size bytes for every CPU node and"
+            << " memory node, and the kernel's node distances." << std::endl;
+  std::cerr << "--pages 2m/1g need reserved huge pages (/proc/sys/vm/nr_hugepages)."
+            << std::endl;
+  std::cerr << "--cpu-node/--mem-node run the other modes on one node's CPUs and"
+            << " memory." << std::endl;
+  std::cerr << "--perf:  hardware counters per access for every latency and tlb"
+            << " size, on stderr." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  SweepOptions opts;
+  std::string mode = "latency";
+  int cpu_node = -1;
+  std::string mem_node;
+  bool perf = false;
+  // std::stoi and friends throw on malformed numbers
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--perf") {
+        perf = true;
+        continue;
+      }
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      if (arg == "--mode") {
+        mode = argv[++i];
+      } else if (arg == "--min-size") {
+        opts.min_bytes = ParseSize(argv[++i]);
+      } else if (arg == "--max-size") {
+        opts.max_bytes = ParseSize(argv[++i]);
+      } else if (arg == "--pages") {
+        if (!ParsePageMode(argv[++i], &opts.pages)) {
+          PrintUsage(argv[0]);
+          return 1;
+        }
+      } else if (arg == "--prefetch-distance") {
+        opts.prefetch_distance = std::stoull(argv[++i]);
+      } else if (arg == "--mlp-size") {
+        opts.mlp_bytes = ParseSize(argv[++i]);
+      } else if (arg == "--repeats") {
+        opts.repeats = std::stoi(argv[++i]);
+      } else if (arg == "--accesses") {
+        opts.accesses = std::stoull(argv[++i]);
+      } else if (arg == "--seed") {
+        opts.seed = std::stoull(argv[++i]);
+      } else if (arg == "--cpu-node") {
+        cpu_node = std::stoi(argv[++i]);
+      } else if (arg == "--mem-node") {
+        mem_node = argv[++i];
+      } else {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+  } catch (const std::logic_error&) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (!ValidMemNode(mem_node)) {
+    std::cerr << "--mem-node must be \"interleave\" or one of the memory nodes:";
+    for (int node : NumaNodes()) {
+      std::cerr << " " << node;
+    }
+    std::cerr << std::endl;
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (opts.min_bytes < 2 * sizeof(Node) || opts.max_bytes < opts.min_bytes ||
+      opts.repeats <= 0 || opts.accesses == 0 ||
+      (mode != "latency" && mode != "mlp" && mode != "tlb" &&
+       mode != "layout" && mode != "numa")) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::unique_ptr<PerfCounters> counters;
+  if (perf) {
+    counters = std::make_unique<PerfCounters>();
+    if (!counters->Error().empty()) {
+      std::cerr << "Some perf counters are unavailable (" << counters->Error()
+                << "), printing n/a for them" << std::endl;
+    }
+    opts.perf = counters.get();
+  }
+
+  try {
+    if (mode != "numa") {
+      ApplyPlacement(cpu_node, mem_node);
+    }
+    if (mode == "mlp") {
+      return RunMlpSweep(opts);
+    }
+    if (mode == "tlb") {
+      return RunTlbSweep(opts);
+    }
+    if (mode == "layout") {
+      return RunLayoutSweep(opts);
+    }
+    if (mode == "numa") {
+      return RunNumaMatrix(opts);
+    }
+    return RunLatencySweep(opts);
+  } catch (const std::system_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,204 @@
+// False Sharing Demo
+//
+// Every thread increments only its own counter, so there is no logical
+// sharing at all; the only thing that differs between the runs is where the
+// counters sit in memory:
+//
+//   packed     - adjacent fields of one struct, eight per cache line
+//   pad64      - each counter followed by filler up to 64 bytes
+//   pad128     - filler up to 128 bytes, past the adjacent-line prefetcher
+//   alignas64  - alignas(64) slots; also line-aligned, unlike the filler
+//   alignas128 - alignas(128) slots
+//   helper     - PerThread<> from cache_line.h
+//
+// With the counters in one line each increment has to pull the line over
+// from whichever core wrote it last, and throughput collapses as threads are
+// added. Threads are pinned to distinct cores where there are enough.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache_line.h"
+#include "numa_placement.h"
+
+constexpr int64_t kDefaultIterations = 100000000;
+
+using Counter = std::atomic<uint64_t>;
+
+// Adjacent: the whole array is one struct of back-to-back counters
+struct PackedSlot {
+  Counter value{0};
+};
+
+struct Padded64Slot {
+  Counter value{0};
+  char pad[64 - sizeof(Counter)];
+};
+
+struct Padded128Slot {
+  Counter value{0};
+  char pad[128 - sizeof(Counter)];
+};
+
+struct alignas(64) Aligned64Slot {
+  Counter value{0};
+};
+
+struct alignas(128) Aligned128Slot {
+  Counter value{0};
+};
+
+// A plain load and store rather than fetch_add: no lock prefix, so the cost
+// is the cache-line transfer and nothing else. Only this thread writes the
+// counter, so no increments are lost.
+inline void Bump(Counter& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+Counter& Get(PackedSlot* slots, int i) { return slots[i].value; }
+Counter& Get(Padded64Slot* slots, int i) { return slots[i].value; }
+Counter& Get(Padded128Slot* slots, int i) { return slots[i].value; }
+Counter& Get(Aligned64Slot* slots, int i) { return slots[i].value; }
+Counter& Get(Aligned128Slot* slots, int i) { return slots[i].value; }
+Counter& Get(PerThread<Counter>* slots, int i) { return (*slots)[i]; }
+
+// Runs `iterations` increments in each of `num_threads` threads on
+// `slots`; returns the elapsed seconds.
+template <typename Slots>
+double RunThreads(Slots* slots, int num_threads, int64_t iterations, bool pin) {
+  const int cores = std::max(1u, std::thread::hardware_concurrency());
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([slots, i, iterations, pin, cores, &ready, &go]() {
+      if (pin && !PinToCpu(i % cores)) {
+        std::cerr << "Warning: Failed to set CPU affinity to core " << i % cores
+                  << std::endl;
+      }
+      Counter& counter = Get(slots, i);
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      for (int64_t n = 0; n < iterations; ++n) {
+        Bump(counter);
+      }
+    });
+  }
+
+  // Start everyone together so thread creation is not timed
+  while (ready.load() < num_threads) {
+    std::this_thread::yield();
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+template <typename Slot>
+double RunLayout(int num_threads, int64_t iterations, bool pin) {
+  std::vector<Slot> slots(num_threads);
+  return RunThreads(slots.data(), num_threads, iterations, pin);
+}
+
+double RunHelper(int num_threads, int64_t iterations, bool pin) {
+  PerThread<Counter> slots(num_threads);
+  return RunThreads(&slots, num_threads, iterations, pin);
+}
+
+void PrintUsage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [--iterations N] [--max-threads N] [--no-pin]"
+            << std::endl;
+  std::cerr << "  --iterations N   increments per thread (default " << kDefaultIterations
+            << ")" << std::endl;
+  std::cerr << "  --max-threads N  largest thread count (default: all cores, at least 4)"
+            << std::endl;
+  std::cerr << "  --no-pin         let the scheduler place the threads" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int64_t iterations = kDefaultIterations;
+  const int cores = std::max(1u, std::thread::hardware_concurrency());
+  int max_threads = std::max(4, cores);
+  bool pin = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--iterations" && i + 1 < argc) {
+      iterations = std::stoll(argv[++i]);
+    } else if (arg == "--max-threads" && i + 1 < argc) {
+      max_threads = std::stoi(argv[++i]);
+    } else if (arg == "--no-pin") {
+      pin = false;
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (iterations <= 0 || max_threads <= 0) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<int> thread_counts;
+  for (int n = 1; n < max_threads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(max_threads);
+
+  struct Layout {
+    const char* name;
+    double (*run)(int, int64_t, bool);
+  };
+  const Layout layouts[] = {
+      {"packed", RunLayout<PackedSlot>},
+      {"pad64", RunLayout<Padded64Slot>},
+      {"pad128", RunLayout<Padded128Slot>},
+      {"alignas64", RunLayout<Aligned64Slot>},
+      {"alignas128", RunLayout<Aligned128Slot>},
+      {"helper", RunHelper},
+  };
+
+  std::cout << "Cores: " << cores << ", helper alignment: " << kFalseSharingRange
+            << " bytes" << (pin ? "" : ", unpinned") << std::endl;
+  if (max_threads > cores) {
+    std::cout << "Note: more threads than cores; those runs time-share and "
+                 "show little false sharing" << std::endl;
+  }
+  std::cout << std::setw(12) << "Layout" << std::setw(10) << "Threads"
+            << std::setw(12) << "Time (s)" << std::setw(12) << "Mops/s"
+            << std::setw(12) << "Scaling" << std::endl;
+  std::cout << std::string(58, '-') << std::endl;
+
+  for (const Layout& layout : layouts) {
+    double single = 0;
+    for (int num_threads : thread_counts) {
+      double elapsed = layout.run(num_threads, iterations, pin);
+      double mops = num_threads * iterations / elapsed / 1e6;
+      if (num_threads == 1) {
+        single = mops;
+      }
+      // Throughput relative to one thread; perfect scaling equals the count
+      std::cout << std::setw(12) << layout.name << std::setw(10) << num_threads
+                << std::setw(12) << std::fixed << std::setprecision(3) << elapsed
+                << std::setw(12) << std::setprecision(1) << mops << std::setw(11)
+                << std::setprecision(2) << (single > 0 ? mops / single : 0) << "x"
+                << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,188 @@
+// Lock zoo
+//
+// Mutual-exclusion primitives with the BasicLockable interface (lock() /
+// unlock()), so they can be dropped into std::lock_guard and compared
+// against std::mutex:
+//
+//   TtasLock   - test-and-test-and-set spinlock with exponential backoff
+//   TicketLock - FIFO spinlock: take a ticket, wait until it is served
+//   McsLock    - queue lock; each waiter spins on its own cache line
+//   FutexLock  - three-state futex mutex (Drepper, "Futexes Are Tricky")
+//
+// The spinning locks yield the CPU after a while: with more threads than
+// cores a spinner would otherwise burn the time slice the lock holder needs.
+
+#ifndef CPU_MEM_LOCKS_H_
+#define CPU_MEM_LOCKS_H_
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Spin-wait helper: pause first, then give up the CPU
+class SpinWait {
+ public:
+  void Wait() {
+    if (++spins_ < kSpinsBeforeYield) {
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  static constexpr int kSpinsBeforeYield = 1000;
+  int spins_ = 0;
+};
+
+class TtasLock {
+ public:
+  void lock() {
+    int backoff = kMinBackoff;
+    SpinWait wait;
+    while (true) {
+      // Spin on a shared read; only try the write when the lock looks free,
+      // so waiters do not bounce the line between cores.
+      while (locked_.load(std::memory_order_relaxed)) {
+        wait.Wait();
+      }
+      if (!locked_.exchange(true, std::memory_order_acquire)) {
+        return;
+      }
+      // Lost the race: back off so the winners spread out in time.
+      for (int i = 0; i < backoff; ++i) {
+        CpuRelax();
+      }
+      backoff = backoff < kMaxBackoff ? backoff * 2 : kMaxBackoff;
+    }
+  }
+
+  void unlock() { locked_.store(false, std::memory_order_release); }
+
+ private:
+  static constexpr int kMinBackoff = 4;
+  static constexpr int kMaxBackoff = 1024;
+  std::atomic<bool> locked_{false};
+};
+
+class TicketLock {
+ public:
+  void lock() {
+    uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    SpinWait wait;
+    while (serving_.load(std::memory_order_acquire) != ticket) {
+      wait.Wait();
+    }
+  }
+
+  void unlock() {
+    serving_.store(serving_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+  }
+
+ private:
+  // Separate lines: arrivals bump next_, the holder bumps serving_.
+  alignas(64) std::atomic<uint32_t> next_{0};
+  alignas(64) std::atomic<uint32_t> serving_{0};
+};
+
+// Mellor-Crummey & Scott. Waiters form a linked queue and each spins on the
+// flag in its own node, so a release touches only the successor's line.
+// Each thread has a single queue node, shared by all McsLocks, so lock() /
+// unlock() keep the BasicLockable signature; the price is that a thread may
+// hold or wait for only one McsLock at a time.
+class McsLock {
+ public:
+  void lock() {
+    Node* node = &MyNode();
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->locked.store(true, std::memory_order_relaxed);
+    Node* prev = tail_.exchange(node, std::memory_order_acq_rel);
+    if (prev == nullptr) {
+      return;
+    }
+    prev->next.store(node, std::memory_order_release);
+    SpinWait wait;
+    while (node->locked.load(std::memory_order_acquire)) {
+      wait.Wait();
+    }
+  }
+
+  void unlock() {
+    Node* node = &MyNode();
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      Node* expected = node;
+      if (tail_.compare_exchange_strong(expected, nullptr,
+                                        std::memory_order_acq_rel)) {
+        return;
+      }
+      // A successor swapped the tail but has not linked itself in yet.
+      SpinWait wait;
+      while ((next = node->next.load(std::memory_order_acquire)) == nullptr) {
+        wait.Wait();
+      }
+    }
+    next->locked.store(false, std::memory_order_release);
+  }
+
+ private:
+  struct alignas(64) Node {
+    std::atomic<Node*> next{nullptr};
+    std::atomic<bool> locked{false};
+  };
+
+  // One node per thread is enough as long as a thread holds at most one
+  // McsLock at a time, which holds for the demos.
+  static Node& MyNode() {
+    thread_local Node node;
+    return node;
+  }
+
+  std::atomic<Node*> tail_{nullptr};
+};
+
+// 0: unlocked, 1: locked, 2: locked and there may be sleepers. Uncontended
+// lock and unlock are a single atomic each; only contention enters the
+// kernel.
+class FutexLock {
+ public:
+  void lock() {
+    uint32_t c = 0;
+    if (state_.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+      return;
+    }
+    if (c != 2) {
+      c = state_.exchange(2, std::memory_order_acquire);
+    }
+    while (c != 0) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_),
+              FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+      c = state_.exchange(2, std::memory_order_acquire);
+    }
+  }
+
+  void unlock() {
+    if (state_.exchange(0, std::memory_order_release) == 2) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_),
+              FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+ private:
+  std::atomic<uint32_t> state_{0};
+};
+
+#endif  // CPU_MEM_LOCKS_H_
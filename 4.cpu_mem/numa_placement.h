@@ -0,0 +1,173 @@
+// NUMA placement helpers
+//
+// Topology from /sys/devices/system/node and placement through the raw
+// sched_setaffinity / set_mempolicy system calls, so nothing needs libnuma.
+// On a box without NUMA (or without the node directory in sysfs) everything
+// reports a single node 0 holding all CPUs, and binding to it is a no-op in
+// effect, so the demos run unchanged.
+//
+// set_mempolicy() applies to the calling thread's future page faults: pages
+// already touched stay where they are, so set the policy before allocating
+// and first touching the memory to be placed.
+
+#ifndef CPU_MEM_NUMA_PLACEMENT_H_
+#define CPU_MEM_NUMA_PLACEMENT_H_
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> ParseIdList(const std::string& text) {
+  std::vector<int> ids;
+  std::istringstream in(text);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int id = first; id <= last; ++id) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+inline std::string ReadSysfsLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Nodes that have memory (or CPUs); {0} without NUMA support
+inline std::vector<int> NumaNodes(bool with_cpus = false) {
+  std::vector<int> nodes = ParseIdList(ReadSysfsLine(
+      with_cpus ? "/sys/devices/system/node/has_cpu"
+                : "/sys/devices/system/node/has_memory"));
+  if (nodes.empty()) {
+    nodes = ParseIdList(ReadSysfsLine("/sys/devices/system/node/online"));
+  }
+  return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+// CPUs of `node`; for node 0 without sysfs, every CPU we may run on
+inline std::vector<int> NodeCpus(int node) {
+  std::vector<int> cpus = ParseIdList(ReadSysfsLine(
+      "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+  if (cpus.empty() && node == 0) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  return cpus;
+}
+
+// The kernel's (ACPI SLIT) distance from `node` to every online node, in the
+// order of /sys/devices/system/node/online; 10 = local
+inline std::vector<int> NodeDistances(int node) {
+  std::istringstream in(ReadSysfsLine("/sys/devices/system/node/node" +
+                                      std::to_string(node) + "/distance"));
+  std::vector<int> distances;
+  int d;
+  while (in >> d) {
+    distances.push_back(d);
+  }
+  return distances;
+}
+
+// Pins the calling thread to one CPU; false on failure
+inline bool PinToCpu(int cpu) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0;
+}
+
+// Lets the calling thread run on any CPU of `node`; false (errno set) on
+// failure
+inline bool BindThreadToNode(int node) {
+  std::vector<int> cpus = NodeCpus(node);
+  if (cpus.empty()) {
+    errno = EINVAL;
+    return false;
+  }
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &cpuset);
+  }
+  return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0;
+}
+
+// Nodes SetMemoryPolicy() can name; the kernel's default MAX_NUMNODES is
+// far lower
+constexpr int kMaxNodes = 1024;
+
+// set_mempolicy(2) for the calling thread: MPOL_BIND to one node,
+// MPOL_INTERLEAVE over several, or MPOL_DEFAULT (nodes ignored) to go back
+// to first-touch local allocation. False (errno set) on failure, e.g. ENOSYS
+// on a kernel without NUMA, or EINVAL for a node outside [0, kMaxNodes).
+inline bool SetMemoryPolicy(int mode, const std::vector<int>& nodes) {
+  constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+  unsigned long mask[kMaxNodes / kBitsPerWord] = {};
+  for (int node : nodes) {
+    if (node < 0 || node >= kMaxNodes) {
+      errno = EINVAL;
+      return false;
+    }
+    mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+  }
+  bool any = mode != MPOL_DEFAULT && !nodes.empty();
+  return syscall(SYS_set_mempolicy, mode, any ? mask : nullptr,
+                 any ? sizeof(mask) * 8 : 0) == 0;
+}
+
+// Node distance matrix as the kernel reports it, e.g.
+//
+//   node    0    1
+//      0   10   21
+//      1   21   10
+inline void PrintNodeDistances(std::ostream& out) {
+  std::vector<int> nodes =
+      ParseIdList(ReadSysfsLine("/sys/devices/system/node/online"));
+  if (nodes.empty()) {
+    nodes = {0};
+  }
+  out << "node";
+  for (int node : nodes) {
+    out << std::setw(5) << node;
+  }
+  out << std::endl;
+  for (int from : nodes) {
+    std::vector<int> distances = NodeDistances(from);
+    out << std::setw(4) << from;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (i < distances.size()) {
+        out << std::setw(5) << distances[i];
+      } else {
+        out << std::setw(5) << (nodes[i] == from ? "10" : "?");
+      }
+    }
+    out << std::endl;
+  }
+}
+
+#endif  // CPU_MEM_NUMA_PLACEMENT_H_
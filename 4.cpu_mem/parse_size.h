@@ -0,0 +1,20 @@
+// Size arguments of the demos' command lines: "4096", "64K", "2G"
+
+#ifndef CPU_MEM_PARSE_SIZE_H_
+#define CPU_MEM_PARSE_SIZE_H_
+
+#include <cstddef>
+#include <string>
+
+// Accepts plain bytes or a K/M/G suffix (binary units)
+inline size_t ParseSize(const std::string& text) {
+  size_t value = std::stoull(text);
+  switch (text.back()) {
+    case 'K': case 'k': return value << 10;
+    case 'M': case 'm': return value << 20;
+    case 'G': case 'g': return value << 30;
+  }
+  return value;
+}
+
+#endif  // CPU_MEM_PARSE_SIZE_H_
@@ -0,0 +1,210 @@
+// Hardware performance counters via perf_event_open(2)
+//
+// Counts cycles, instructions, LLC / L1D / dTLB read misses and context
+// switches for the whole process, including threads started after the
+// counters were opened (perf's inherit flag folds a thread's counts into the
+// parent's when it exits). Take a Read() before and after the measured
+// section and subtract:
+//
+//   PerfCounters perf;
+//   PerfCounters::Sample start = perf.Read();
+//   ... run and join the threads ...
+//   PerfCounters::Sample delta = PerfCounters::Delta(start, perf.Read());
+//
+// The demos do this through BenchmarkMeasurement (benchmark_measurement.h).
+//
+// Events that cannot be opened (no PMU in a VM, perf_event_paranoid, missing
+// CAP_PERFMON) are simply absent from the samples, so the demos keep working
+// and print "n/a" instead. Hardware events count user space only so that the
+// default perf_event_paranoid=2 still allows them.
+
+#ifndef CPU_MEM_PERF_COUNTERS_H_
+#define CPU_MEM_PERF_COUNTERS_H_
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+class PerfCounters {
+ public:
+  enum Event {
+    kCycles,
+    kInstructions,
+    kLlcMisses,
+    kL1dMisses,
+    kDtlbMisses,
+    kContextSwitches,
+    kNumEvents
+  };
+
+  // Counts scaled for multiplexing; empty for events that are not available
+  using Sample = std::array<std::optional<double>, kNumEvents>;
+
+  PerfCounters() {
+    for (int e = 0; e < kNumEvents; ++e) {
+      fds_[e] = Open(static_cast<Event>(e));
+      if (fds_[e] == -1 && error_.empty()) {
+        error_ = std::string(Name(static_cast<Event>(e))) + ": " + strerror(errno);
+      }
+    }
+  }
+
+  ~PerfCounters() {
+    for (int fd : fds_) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool Available() const {
+    for (int fd : fds_) {
+      if (fd != -1) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // First failure, e.g. "cycles: Permission denied"; empty if all opened
+  const std::string& Error() const { return error_; }
+
+  // Running totals since the counters were opened
+  Sample Read() const {
+    Sample sample;
+    for (int e = 0; e < kNumEvents; ++e) {
+      // PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+      uint64_t data[3];
+      if (fds_[e] == -1 || read(fds_[e], data, sizeof(data)) != sizeof(data)) {
+        continue;
+      }
+      // With more events than hardware counters the kernel time-slices them;
+      // extrapolate to the whole enabled time.
+      double value = data[0];
+      if (data[2] > 0 && data[2] < data[1]) {
+        value *= static_cast<double>(data[1]) / data[2];
+      }
+      sample[e] = value;
+    }
+    return sample;
+  }
+
+  static Sample Delta(const Sample& start, const Sample& end) {
+    Sample delta;
+    for (int e = 0; e < kNumEvents; ++e) {
+      if (start[e] && end[e]) {
+        delta[e] = *end[e] - *start[e];
+      }
+    }
+    return delta;
+  }
+
+  static const char* Name(Event event) {
+    switch (event) {
+      case kCycles: return "cycles";
+      case kInstructions: return "instructions";
+      case kLlcMisses: return "LLC-load-misses";
+      case kL1dMisses: return "L1-dcache-load-misses";
+      case kDtlbMisses: return "dTLB-load-misses";
+      case kContextSwitches: return "context-switches";
+      case kNumEvents: break;
+    }
+    return "?";
+  }
+
+  // "IPC 1.23  LLC/op 0.01  L1D/op 0.50  dTLB/op 0.00  CS 12" style summary
+  // of a delta, normalized by the number of operations it covered.
+  static std::string Summary(const Sample& delta, double ops) {
+    std::ostringstream out;
+    out << std::fixed;
+    auto field = [&out](const char* label, std::optional<double> value, int precision) {
+      out << "  " << label << " ";
+      if (value) {
+        out << std::setprecision(precision) << *value;
+      } else {
+        out << "n/a";
+      }
+    };
+    std::optional<double> ipc;
+    if (delta[kCycles] && delta[kInstructions] && *delta[kCycles] > 0) {
+      ipc = *delta[kInstructions] / *delta[kCycles];
+    }
+    auto per_op = [&delta, ops](Event e) -> std::optional<double> {
+      if (!delta[e] || ops <= 0) {
+        return std::nullopt;
+      }
+      return *delta[e] / ops;
+    };
+    field("IPC", ipc, 2);
+    field("LLC/op", per_op(kLlcMisses), 3);
+    field("L1D/op", per_op(kL1dMisses), 3);
+    field("dTLB/op", per_op(kDtlbMisses), 3);
+    field("CS", delta[kContextSwitches], 0);
+    return out.str();
+  }
+
+ private:
+  static int Open(Event event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+      case kCycles:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case kInstructions:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case kLlcMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = CacheReadMiss(PERF_COUNT_HW_CACHE_LL);
+        break;
+      case kL1dMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = CacheReadMiss(PERF_COUNT_HW_CACHE_L1D);
+        break;
+      case kDtlbMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = CacheReadMiss(PERF_COUNT_HW_CACHE_DTLB);
+        break;
+      case kContextSwitches:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+        break;
+      case kNumEvents:
+        return -1;
+    }
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    // A context switch happens in the kernel, so that one event has to count
+    // kernel mode too, which needs perf_event_paranoid <= 1.
+    attr.exclude_kernel = event != kContextSwitches;
+    attr.exclude_hv = 1;
+    // This process and its future threads, on any CPU
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  static uint64_t CacheReadMiss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  std::array<int, kNumEvents> fds_;
+  std::string error_;
+};
+
+#endif  // CPU_MEM_PERF_COUNTERS_H_
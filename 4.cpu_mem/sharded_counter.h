@@ -0,0 +1,134 @@
+// Sharded counter
+//
+// A statistics counter that scales with the number of writers: every shard
+// lives in its own cache line and a writer only touches "its" shard, so
+// increments stay local instead of bouncing one line between all cores.
+// Reads pay instead, by summing the shards.
+//
+//   ShardedCounter::Mode::kPerCpu    - shard of the CPU the caller runs on,
+//                                      from rseq's cpu_id (glibc >= 2.35) or
+//                                      sched_getcpu()
+//   ShardedCounter::Mode::kPerThread - shard assigned round-robin to each
+//                                      thread on first use
+//
+// A thread can migrate between picking a shard and updating it, and threads
+// can share a shard, so updates are still atomic; they are just almost never
+// contended.
+
+#ifndef CPU_MEM_SHARDED_COUNTER_H_
+#define CPU_MEM_SHARDED_COUNTER_H_
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define CPU_MEM_HAVE_RSEQ 1
+#endif
+
+#include "cache_line.h"
+
+// CPU the calling thread is running on right now; may be stale as soon as it
+// returns.
+inline unsigned CurrentCpu() {
+#ifdef CPU_MEM_HAVE_RSEQ
+  // glibc registers rseq for every thread; the kernel keeps cpu_id up to
+  // date, so this is a plain load instead of a call into the vDSO.
+  if (__rseq_size > 0) {
+    auto* rs = reinterpret_cast<const volatile struct rseq*>(
+        static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+    int32_t cpu = static_cast<int32_t>(rs->cpu_id);
+    if (cpu >= 0) {
+      return cpu;
+    }
+  }
+#endif
+  int cpu = sched_getcpu();
+  return cpu >= 0 ? cpu : 0;
+}
+
+class ShardedCounter {
+ public:
+  enum class Mode { kPerCpu, kPerThread };
+
+  // num_shards == 0 picks one shard per CPU.
+  explicit ShardedCounter(Mode mode, unsigned num_shards = 0)
+      : mode_(mode),
+        num_shards_(num_shards > 0 ? num_shards
+                                   : std::max(1u, std::thread::hardware_concurrency())),
+        shards_(new Shard[num_shards_]) {}
+
+  void Add(uint64_t n = 1) {
+    shards_[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // Cheap read: sums the shards without coordination. Increments that race
+  // with it may or may not be included, so the result is only approximate
+  // while writers are active.
+  uint64_t Read() const {
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < num_shards_; ++i) {
+      sum += shards_[i].value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  // Exact read: the value the counter had at some instant during the call.
+  // Shards only grow, so if two passes over them see the same values nothing
+  // changed in between (double collect). Writers are never blocked; the
+  // reader retries while they keep changing shards under it, which makes
+  // this expensive under heavy write traffic.
+  uint64_t Snapshot() const {
+    std::unique_ptr<uint64_t[]> prev(new uint64_t[num_shards_]);
+    Collect(prev.get());
+    std::unique_ptr<uint64_t[]> cur(new uint64_t[num_shards_]);
+    while (true) {
+      Collect(cur.get());
+      uint64_t sum = 0;
+      bool same = true;
+      for (unsigned i = 0; i < num_shards_; ++i) {
+        same = same && cur[i] == prev[i];
+        sum += cur[i];
+      }
+      if (same) {
+        return sum;
+      }
+      prev.swap(cur);
+    }
+  }
+
+  unsigned NumShards() const { return num_shards_; }
+
+ private:
+  struct alignas(kDestructiveInterferenceSize) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+
+  unsigned ShardIndex() const {
+    if (mode_ == Mode::kPerCpu) {
+      return CurrentCpu() % num_shards_;
+    }
+    static std::atomic<unsigned> next_thread{0};
+    thread_local unsigned thread_id =
+        next_thread.fetch_add(1, std::memory_order_relaxed);
+    return thread_id % num_shards_;
+  }
+
+  void Collect(uint64_t* values) const {
+    for (unsigned i = 0; i < num_shards_; ++i) {
+      values[i] = shards_[i].value.load(std::memory_order_acquire);
+    }
+  }
+
+  const Mode mode_;
+  const unsigned num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+#endif  // CPU_MEM_SHARDED_COUNTER_H_
@@ -0,0 +1,510 @@
+// STREAM-style Memory Bandwidth Demo
+//
+// McCalpin's four STREAM kernels over arrays much larger than the caches:
+//
+//   copy   c[i] = a[i]             16 bytes per element
+//   scale  b[i] = s * c[i]         16
+//   add    c[i] = a[i] + b[i]      24
+//   triad  a[i] = b[i] + s * c[i]  24
+//
+// Each kernel comes in scalar, SSE2, AVX2 and AVX-512 versions; the SIMD
+// ones are compiled with target attributes and picked at runtime by what the
+// CPU supports. They also come with normal and non-temporal (streaming)
+// stores: a normal store first reads the line it writes (write-allocate), a
+// streaming store skips that read and the cache, so stores should get
+// cheaper by about a third.
+//
+// Threads are pinned one per physical core, filling a socket before moving
+// on to the next, and touch their own part of the arrays first so the pages
+// end up on their node. The scaling mode shows the thread count at which
+// extra cores stop adding bandwidth: past it, memory-bound loops do not get
+// faster with more threads.
+
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STREAM_X86 1
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "numa_placement.h"
+#include "parse_size.h"
+
+constexpr double kScalar = 3.0;
+
+// Chunks handed to threads start at multiples of this many elements, so
+// every SIMD store in them is aligned (arrays are page-aligned).
+constexpr size_t kChunkAlign = 8;
+
+enum class Kernel { kCopy, kScale, kAdd, kTriad };
+
+const Kernel kKernels[] = {Kernel::kCopy, Kernel::kScale, Kernel::kAdd,
+                           Kernel::kTriad};
+
+const char* KernelName(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::kCopy: return "copy";
+    case Kernel::kScale: return "scale";
+    case Kernel::kAdd: return "add";
+    case Kernel::kTriad: return "triad";
+  }
+  return "?";
+}
+
+// Bytes moved per element, counted the STREAM way (no write-allocate reads)
+size_t KernelBytes(Kernel kernel) {
+  return (kernel == Kernel::kAdd || kernel == Kernel::kTriad ? 3 : 2) *
+         sizeof(double);
+}
+
+struct Arrays {
+  double* a;
+  double* b;
+  double* c;
+  size_t n;
+};
+
+using KernelFn = void (*)(Kernel, const Arrays&, size_t begin, size_t end);
+
+// Kept scalar on purpose: no auto-vectorization and no memcpy for copy
+__attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+void ScalarKernel(Kernel kernel, const Arrays& x, size_t begin, size_t end) {
+  double* __restrict a = x.a;
+  double* __restrict b = x.b;
+  double* __restrict c = x.c;
+  switch (kernel) {
+    case Kernel::kCopy:
+      for (size_t i = begin; i < end; ++i) c[i] = a[i];
+      break;
+    case Kernel::kScale:
+      for (size_t i = begin; i < end; ++i) b[i] = kScalar * c[i];
+      break;
+    case Kernel::kAdd:
+      for (size_t i = begin; i < end; ++i) c[i] = a[i] + b[i];
+      break;
+    case Kernel::kTriad:
+      for (size_t i = begin; i < end; ++i) a[i] = b[i] + kScalar * c[i];
+      break;
+  }
+}
+
+#ifdef STREAM_X86
+
+// The vector loops stop at the last full vector; the scalar kernel finishes
+// the range.
+#define STREAM_SIMD_KERNEL(Name, Target, Vec, kWidth, Load, Store, Stream,  \
+                           Add, Mul, Set1)                                   \
+  template <bool kStream>                                                    \
+  __attribute__((target(Target))) void Name(Kernel kernel, const Arrays& x,  \
+                                            size_t begin, size_t end) {      \
+    const Vec s = Set1(kScalar);                                             \
+    size_t i = begin;                                                        \
+    auto store = [](double* p, Vec v) __attribute__((target(Target))) {      \
+      if (kStream) {                                                         \
+        Stream(p, v);                                                        \
+      } else {                                                               \
+        Store(p, v);                                                         \
+      }                                                                      \
+    };                                                                       \
+    switch (kernel) {                                                        \
+      case Kernel::kCopy:                                                    \
+        for (; i + kWidth <= end; i += kWidth) {                             \
+          store(x.c + i, Load(x.a + i));                                     \
+        }                                                                    \
+        break;                                                               \
+      case Kernel::kScale:                                                   \
+        for (; i + kWidth <= end; i += kWidth) {                             \
+          store(x.b + i, Mul(s, Load(x.c + i)));                             \
+        }                                                                    \
+        break;                                                               \
+      case Kernel::kAdd:                                                     \
+        for (; i + kWidth <= end; i += kWidth) {                             \
+          store(x.c + i, Add(Load(x.a + i), Load(x.b + i)));                 \
+        }                                                                    \
+        break;                                                               \
+      case Kernel::kTriad:                                                   \
+        for (; i + kWidth <= end; i += kWidth) {                             \
+          store(x.a + i, Add(Load(x.b + i), Mul(s, Load(x.c + i))));         \
+        }                                                                    \
+        break;                                                               \
+    }                                                                        \
+    if (kStream) {                                                           \
+      /* Streaming stores are weakly ordered; publish them before the */    \
+      /* caller's barrier. */                                                \
+      _mm_sfence();                                                          \
+    }                                                                        \
+    ScalarKernel(kernel, x, i, end);                                         \
+  }
+
+STREAM_SIMD_KERNEL(Sse2Kernel, "sse2", __m128d, 2, _mm_load_pd, _mm_store_pd,
+                   _mm_stream_pd, _mm_add_pd, _mm_mul_pd, _mm_set1_pd)
+STREAM_SIMD_KERNEL(Avx2Kernel, "avx2", __m256d, 4, _mm256_load_pd,
+                   _mm256_store_pd, _mm256_stream_pd, _mm256_add_pd,
+                   _mm256_mul_pd, _mm256_set1_pd)
+STREAM_SIMD_KERNEL(Avx512Kernel, "avx512f", __m512d, 8, _mm512_load_pd,
+                   _mm512_store_pd, _mm512_stream_pd, _mm512_add_pd,
+                   _mm512_mul_pd, _mm512_set1_pd)
+
+#undef STREAM_SIMD_KERNEL
+
+#endif  // STREAM_X86
+
+struct Variant {
+  std::string isa;
+  bool streaming;
+  KernelFn run;
+};
+
+// Everything this CPU can run, narrowest first
+std::vector<Variant> SupportedVariants() {
+  std::vector<Variant> variants = {{"scalar", false, ScalarKernel}};
+#ifdef STREAM_X86
+  __builtin_cpu_init();
+  variants.push_back({"sse2", false, Sse2Kernel<false>});
+  variants.push_back({"sse2", true, Sse2Kernel<true>});
+  if (__builtin_cpu_supports("avx2")) {
+    variants.push_back({"avx2", false, Avx2Kernel<false>});
+    variants.push_back({"avx2", true, Avx2Kernel<true>});
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    variants.push_back({"avx512", false, Avx512Kernel<false>});
+    variants.push_back({"avx512", true, Avx512Kernel<true>});
+  }
+#endif
+  return variants;
+}
+
+int ReadTopologyValue(int cpu, const char* name) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/" + name);
+  int value = 0;
+  file >> value;
+  return value;
+}
+
+struct PinnedCpu {
+  int cpu;
+  int package;
+};
+
+// CPUs this process may run on, in the order threads are added: one per
+// physical core of the first socket, then of the next socket, and only then
+// the SMT siblings.
+std::vector<PinnedCpu> PinOrder() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+
+  std::map<std::pair<int, int>, int> siblings_seen;
+  std::vector<std::tuple<int, int, int, int>> order;  // sibling, package, core, cpu
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed)) {
+      continue;
+    }
+    int package = ReadTopologyValue(cpu, "physical_package_id");
+    int core = ReadTopologyValue(cpu, "core_id");
+    int sibling = siblings_seen[{package, core}]++;
+    order.emplace_back(sibling, package, core, cpu);
+  }
+  std::sort(order.begin(), order.end(), [](const auto& x, const auto& y) {
+    return std::tie(std::get<0>(x), std::get<1>(x), std::get<2>(x), std::get<3>(x)) <
+           std::tie(std::get<0>(y), std::get<1>(y), std::get<2>(y), std::get<3>(y));
+  });
+
+  std::vector<PinnedCpu> cpus;
+  for (const auto& [sibling, package, core, cpu] : order) {
+    cpus.push_back({cpu, package});
+  }
+  return cpus;
+}
+
+// Pinned threads that run the same task together, so thread start-up is not
+// part of the timed region.
+class WorkerPool {
+ public:
+  explicit WorkerPool(const std::vector<PinnedCpu>& cpus) {
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      threads_.emplace_back([this, i, cpu = cpus[i].cpu]() {
+        if (!PinToCpu(cpu)) {
+          std::cerr << "Warning: Failed to set CPU affinity to core " << cpu
+                    << std::endl;
+        }
+        Loop(i);
+      });
+    }
+  }
+
+  ~WorkerPool() {
+    stop_.store(true);
+    generation_.fetch_add(1);
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  size_t size() const { return threads_.size(); }
+
+  // Runs task(worker) on every worker; returns the elapsed seconds
+  double Run(const std::function<void(size_t)>& task) {
+    task_ = &task;
+    done_.store(0);
+    auto start = std::chrono::steady_clock::now();
+    generation_.fetch_add(1, std::memory_order_release);
+    while (done_.load(std::memory_order_acquire) < threads_.size()) {
+      std::this_thread::yield();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  }
+
+ private:
+  void Loop(size_t worker) {
+    uint64_t seen = 0;
+    while (true) {
+      uint64_t generation;
+      while ((generation = generation_.load(std::memory_order_acquire)) == seen) {
+        std::this_thread::yield();
+      }
+      seen = generation;
+      if (stop_.load()) {
+        return;
+      }
+      (*task_)(worker);
+      done_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  const std::function<void(size_t)>* task_ = nullptr;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<size_t> done_{0};
+  std::atomic<bool> stop_{false};
+};
+
+// [begin, end) of worker's share of n elements
+std::pair<size_t, size_t> Chunk(size_t n, size_t worker, size_t workers) {
+  size_t blocks = n / kChunkAlign;
+  size_t begin = blocks * worker / workers * kChunkAlign;
+  size_t end = worker + 1 == workers ? n : blocks * (worker + 1) / workers * kChunkAlign;
+  return {begin, end};
+}
+
+struct Rate {
+  double best_mb_s;
+  double avg_mb_s;
+};
+
+// Runs one kernel `repeats` times on all workers of the pool
+Rate Measure(WorkerPool& pool, const Arrays& x, Kernel kernel, KernelFn run,
+             int repeats) {
+  std::function<void(size_t)> task = [&](size_t worker) {
+    auto [begin, end] = Chunk(x.n, worker, pool.size());
+    run(kernel, x, begin, end);
+  };
+  pool.Run(task);  // Warm-up
+
+  double best = 0, sum = 0;
+  for (int r = 0; r < repeats; ++r) {
+    double seconds = pool.Run(task);
+    double rate = KernelBytes(kernel) * x.n / seconds / 1e6;
+    best = std::max(best, rate);
+    sum += rate;
+  }
+  return {best, sum / repeats};
+}
+
+// Allocates and first-touches the arrays from the pool's threads so every
+// chunk lives on the node of the thread that uses it
+Arrays AllocateArrays(WorkerPool& pool, size_t n) {
+  size_t bytes = (n * sizeof(double) + 4095) / 4096 * 4096;
+  Arrays x;
+  x.a = static_cast<double*>(std::aligned_alloc(4096, bytes));
+  x.b = static_cast<double*>(std::aligned_alloc(4096, bytes));
+  x.c = static_cast<double*>(std::aligned_alloc(4096, bytes));
+  x.n = n;
+  if (!x.a || !x.b || !x.c) {
+    throw std::bad_alloc();
+  }
+  pool.Run([&x, &pool](size_t worker) {
+    auto [begin, end] = Chunk(x.n, worker, pool.size());
+    for (size_t i = begin; i < end; ++i) {
+      x.a[i] = 1.0;
+      x.b[i] = 2.0;
+      x.c[i] = 0.0;
+    }
+  });
+  return x;
+}
+
+void FreeArrays(const Arrays& x) {
+  std::free(x.a);
+  std::free(x.b);
+  std::free(x.c);
+}
+
+// Every kernel and variant, single-threaded and on all allowed cores
+void RunKernels(const std::vector<Variant>& variants,
+                const std::vector<PinnedCpu>& cpus, size_t n, int repeats) {
+  std::cout << "kernel,isa,stores,threads,best_mb_per_s,avg_mb_per_s" << std::endl;
+  std::vector<size_t> thread_counts = {1};
+  if (cpus.size() > 1) {
+    thread_counts.push_back(cpus.size());
+  }
+  for (size_t threads : thread_counts) {
+    WorkerPool pool(std::vector<PinnedCpu>(cpus.begin(), cpus.begin() + threads));
+    Arrays x = AllocateArrays(pool, n);
+    for (Kernel kernel : kKernels) {
+      for (const Variant& v : variants) {
+        Rate rate = Measure(pool, x, kernel, v.run, repeats);
+        std::cout << KernelName(kernel) << "," << v.isa << ","
+                  << (v.streaming ? "nt" : "normal") << "," << threads << ","
+                  << std::fixed << std::setprecision(0) << rate.best_mb_s << ","
+                  << rate.avg_mb_s << std::endl;
+      }
+    }
+    FreeArrays(x);
+  }
+}
+
+// Triad bandwidth of the widest ISA for 1..all threads, and where it stops
+// scaling
+void RunScaling(const std::vector<Variant>& variants,
+                const std::vector<PinnedCpu>& cpus, size_t n, int repeats) {
+  std::vector<Variant> widest;
+  for (const Variant& v : variants) {
+    if (v.isa == variants.back().isa) {
+      widest.push_back(v);
+    }
+  }
+
+  std::map<std::string, std::vector<double>> curves;
+  std::cout << "threads,sockets,isa,stores,triad_mb_per_s,per_thread_mb_per_s"
+            << std::endl;
+  for (size_t threads = 1; threads <= cpus.size(); ++threads) {
+    std::vector<PinnedCpu> used(cpus.begin(), cpus.begin() + threads);
+    std::set<int> packages;
+    for (const PinnedCpu& cpu : used) {
+      packages.insert(cpu.package);
+    }
+    WorkerPool pool(used);
+    Arrays x = AllocateArrays(pool, n);
+    for (const Variant& v : widest) {
+      Rate rate = Measure(pool, x, Kernel::kTriad, v.run, repeats);
+      std::string name = v.isa + (v.streaming ? "/nt" : "/normal");
+      curves[name].push_back(rate.best_mb_s);
+      std::cout << threads << "," << packages.size() << "," << v.isa << ","
+                << (v.streaming ? "nt" : "normal") << "," << std::fixed
+                << std::setprecision(0) << rate.best_mb_s << ","
+                << rate.best_mb_s / threads << std::endl;
+    }
+    FreeArrays(x);
+  }
+
+  std::cerr << "Triad saturation:" << std::endl;
+  for (const auto& [name, curve] : curves) {
+    double peak = *std::max_element(curve.begin(), curve.end());
+    size_t knee = 0;
+    while (curve[knee] < 0.9 * peak) {
+      ++knee;
+    }
+    std::cerr << "  " << name << ": peak " << std::fixed << std::setprecision(0)
+              << peak << " MB/s; 90% of it with " << knee + 1 << " of "
+              << curve.size() << " threads" << std::endl;
+  }
+}
+
+void PrintUsage(const char* prog) {
+  std::cerr << "Usage: " << prog << " [options]" << std::endl;
+  std::cerr << "  --mode kernels|scaling  all kernels at 1 and all threads, or triad "
+               "vs thread count (default kernels)" << std::endl;
+  std::cerr << "  --size N[K|M|G]         bytes per array (default 128M)" << std::endl;
+  std::cerr << "  --repeats N             timed runs per point, best is reported "
+               "(default 10)" << std::endl;
+  std::cerr << "  --max-threads N         use at most N cores (default all)" << std::endl;
+  std::cerr << "  --isa LIST              limit to some of scalar,sse2,avx2,avx512"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::string mode = "kernels";
+  size_t bytes = 128 << 20;
+  int repeats = 10;
+  size_t max_threads = 0;
+  std::string isa_list;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    if (arg == "--mode") {
+      mode = argv[++i];
+    } else if (arg == "--size") {
+      bytes = ParseSize(argv[++i]);
+    } else if (arg == "--repeats") {
+      repeats = std::stoi(argv[++i]);
+    } else if (arg == "--max-threads") {
+      max_threads = std::stoul(argv[++i]);
+    } else if (arg == "--isa") {
+      isa_list = "," + std::string(argv[++i]) + ",";
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  size_t n = bytes / sizeof(double);
+  if (n < kChunkAlign || repeats <= 0 || (mode != "kernels" && mode != "scaling")) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Variant> variants;
+  for (const Variant& v : SupportedVariants()) {
+    if (isa_list.empty() || isa_list.find("," + v.isa + ",") != std::string::npos) {
+      variants.push_back(v);
+    }
+  }
+  if (variants.empty()) {
+    std::cerr << "None of the requested ISAs is supported here" << std::endl;
+    return 1;
+  }
+
+  std::vector<PinnedCpu> cpus = PinOrder();
+  if (cpus.empty()) {
+    cpus.push_back({0, 0});
+  }
+  if (max_threads > 0 && max_threads < cpus.size()) {
+    cpus.resize(max_threads);
+  }
+  std::cerr << "ISAs:";
+  for (const Variant& v : variants) {
+    if (!v.streaming) {
+      std::cerr << " " << v.isa;
+    }
+  }
+  std::cerr << "; " << cpus.size() << " cores; 3 arrays of " << (bytes >> 20)
+            << " MiB" << std::endl;
+
+  if (mode == "kernels") {
+    RunKernels(variants, cpus, n, repeats);
+  } else {
+    RunScaling(variants, cpus, n, repeats);
+  }
+  return 0;
+}
@@ -5,10 +5,15 @@
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "benchmark_measurement.h"
+#include "perf_counters.h"
+
 void PinToCore(int core_id) {
   cpu_set_t cpuset;
   CPU_ZERO(&cpuset);
@@ -24,10 +29,14 @@ void PinToCore(int core_id) {
 struct ExperimentResult {
   uint64_t total_count;
   uint64_t random_sum;
+  BenchmarkMeasurement measure;
 };
 
+// `counters` may be null; with them the result also holds the hardware
+// counts per yield, including the context switches actually taken.
 ExperimentResult RunExperiment(size_t num_threads,
-                                std::chrono::duration<double> duration) {
+                                std::chrono::duration<double> duration,
+                                const PerfCounters* counters) {
   // Pin this process to core 0
   PinToCore(0);
 
@@ -39,6 +48,8 @@ ExperimentResult RunExperiment(size_t num_threads,
   std::vector<uint64_t> counts(num_threads);
   std::vector<uint64_t> last_randoms(num_threads);
 
+  BenchmarkMeasurement measure(counters);
+  measure.Start();
   for (size_t i = 0; i < num_threads; i++) {
     threads.emplace_back([&counts, &last_randoms, i, deadline]() {
       std::mt19937_64 rng(12345 + i);
@@ -60,6 +71,7 @@ ExperimentResult RunExperiment(size_t num_threads,
   for (auto& thread : threads) {
     thread.join();
   }
+  measure.Stop();
 
   // Sum up counts and random numbers
   uint64_t total_count = 0;
@@ -68,13 +80,25 @@ ExperimentResult RunExperiment(size_t num_threads,
     total_count += counts[i];
     random_sum += last_randoms[i];
   }
+  measure.SetTotalOperations(total_count);
 
-  return {total_count, random_sum};
+  return {total_count, random_sum, measure};
 }
 
-int main() {
+int main(int argc, char* argv[]) {
   using namespace std::chrono_literals;
 
+  // Usage: context_switch_demo [--perf]
+  std::unique_ptr<PerfCounters> counters;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--perf") {
+      counters = std::make_unique<PerfCounters>();
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--perf]" << std::endl;
+      return 1;
+    }
+  }
+
   constexpr auto kDuration = 10s;
   std::vector<size_t> thread_counts = {1, 2, 5, 10, 20, 50, 100, 200, 500};
 
@@ -98,7 +122,7 @@ int main() {
     std::cout << "Running with " << num_threads << " thread(s)... "
               << std::flush;
 
-    auto result = RunExperiment(num_threads, kDuration);
+    auto result = RunExperiment(num_threads, kDuration, counters.get());
     double yields_per_sec = result.total_count / kDuration.count();
     total_random_sum += result.random_sum;
 
@@ -128,7 +152,7 @@ int main() {
                 << context_switch_time_us;
     }
 
-    std::cout << std::endl;
+    std::cout << result.measure.CounterSummary() << std::endl;
   }
 
   std::cout << std::endl;
@@ -139,6 +163,9 @@ int main() {
   std::cout << std::endl;
   std::cout << "Random number checksum: " << total_random_sum
             << " (prevents optimization)" << std::endl;
+  if (counters && !counters->Error().empty()) {
+    std::cout << "Counters unavailable: " << counters->Error() << std::endl;
+  }
 
   return 0;
 }
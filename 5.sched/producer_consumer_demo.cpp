@@ -1,13 +1,16 @@
-#include <chrono>
 #include <condition_variable>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <vector>
 
+#include "benchmark_measurement.h"
+#include "perf_counters.h"
+
 // Default configuration
 constexpr size_t kDefaultAllocSize = 64;
 constexpr size_t kDefaultBatchSize = 1000;
@@ -121,7 +124,7 @@ void SameThreadWorker(size_t num_batches, size_t batch_size,
 void PrintUsage(const char* prog_name) {
   std::cout << "Usage: " << prog_name
             << " [--same-thread] [--pairs N] [--alloc-size N] "
-            << "[--batch-size N] [--num-batches N]" << std::endl;
+            << "[--batch-size N] [--num-batches N] [--perf]" << std::endl;
   std::cout << "  --same-thread    : Single thread mode (baseline)" << std::endl;
   std::cout << "  --pairs N        : Number of producer-consumer pairs (default: "
             << kDefaultNumPairs << ")" << std::endl;
@@ -131,6 +134,8 @@ void PrintUsage(const char* prog_name) {
             << kDefaultBatchSize << ")" << std::endl;
   std::cout << "  --num-batches N  : Number of batches (default: "
             << kDefaultNumBatches << ")" << std::endl;
+  std::cout << "  --perf           : Report IPC and cache/TLB misses per allocation"
+            << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -140,6 +145,7 @@ int main(int argc, char* argv[]) {
   size_t alloc_size = kDefaultAllocSize;
   size_t batch_size = kDefaultBatchSize;
   size_t num_batches = kDefaultNumBatches;
+  bool perf = false;
 
   for (int i = 1; i < argc; i++) {
     std::string arg = argv[i];
@@ -153,6 +159,8 @@ int main(int argc, char* argv[]) {
       batch_size = std::atoi(argv[++i]);
     } else if (arg == "--num-batches" && i + 1 < argc) {
       num_batches = std::atoi(argv[++i]);
+    } else if (arg == "--perf") {
+      perf = true;
     } else if (arg == "--help" || arg == "-h") {
       PrintUsage(argv[0]);
       return 0;
@@ -179,7 +187,13 @@ int main(int argc, char* argv[]) {
             << std::endl;
   std::cout << std::endl;
 
-  auto start = std::chrono::high_resolution_clock::now();
+  std::unique_ptr<PerfCounters> counters;
+  if (perf) {
+    counters = std::make_unique<PerfCounters>();
+  }
+
+  BenchmarkMeasurement measure(counters.get());
+  measure.Start();
 
   if (same_thread) {
     // Same-thread mode: launch N independent threads
@@ -209,20 +223,27 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  auto end = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> elapsed = end - start;
+  measure.Stop();
+  measure.SetTotalOperations(num_batches * batch_size * num_pairs);
 
   // Display results
-  double total_ops = num_batches * batch_size * num_pairs;
-  double ops_per_second = total_ops / elapsed.count();
+  double elapsed = measure.seconds();
+  double total_ops = measure.operations();
+  double ops_per_second = measure.operations_per_second();
 
   std::cout << "Results:" << std::endl;
   std::cout << "  Time elapsed: " << std::fixed << std::setprecision(3)
-            << elapsed.count() << " seconds" << std::endl;
+            << elapsed << " seconds" << std::endl;
   std::cout << "  Operations/sec: " << std::fixed << std::setprecision(0)
             << ops_per_second << std::endl;
   std::cout << "  Time per operation: " << std::fixed << std::setprecision(3)
-            << (elapsed.count() / total_ops * 1e9) << " ns" << std::endl;
+            << (elapsed / total_ops * 1e9) << " ns" << std::endl;
+  if (counters) {
+    std::cout << "  Counters:" << measure.CounterSummary() << std::endl;
+    if (!counters->Error().empty()) {
+      std::cout << "  (unavailable: " << counters->Error() << ")" << std::endl;
+    }
+  }
 
   return 0;
 }
@@ -2,7 +2,7 @@
 
 # Compile the demo
 echo "Compiling tcache_demo.cpp..."
-g++ -O2 -std=c++17 -pthread tcache_demo.cpp -o tcache_demo
+g++ -O2 -std=c++17 -pthread -I../4.cpu_mem tcache_demo.cpp -o tcache_demo
 
 if [ $? -ne 0 ]; then
     echo "Compilation failed!"
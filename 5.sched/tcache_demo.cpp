@@ -1,21 +1,27 @@
-#include <chrono>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "benchmark_measurement.h"
+#include "perf_counters.h"
+
 // Number of allocation/deallocation cycles per thread
 constexpr size_t kIterations = 100000000;
 
 // Size of allocations (should be within tcache range)
 constexpr size_t kAllocSize = 64;
 
-// Run benchmark with specified number of threads
-double RunBenchmark(int num_threads, size_t iterations_per_thread) {
+// Run benchmark with specified number of threads; `counters` may be null
+BenchmarkMeasurement RunBenchmark(int num_threads, size_t iterations_per_thread,
+                                  const PerfCounters* counters) {
   std::vector<std::thread> threads;
 
-  auto start = std::chrono::high_resolution_clock::now();
+  BenchmarkMeasurement measure(counters);
+  measure.Start();
 
   // Launch threads with lambda worker
   for (int i = 0; i < num_threads; i++) {
@@ -41,17 +47,22 @@ double RunBenchmark(int num_threads, size_t iterations_per_thread) {
     t.join();
   }
 
-  auto end = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> elapsed = end - start;
-
-  return elapsed.count();
+  measure.Stop();
+  measure.SetTotalOperations(num_threads * iterations_per_thread);
+  return measure;
 }
 
 int main(int argc, char* argv[]) {
   int num_threads = std::thread::hardware_concurrency();
-
-  if (argc > 1) {
-    num_threads = std::atoi(argv[1]);
+  bool perf = false;
+
+  // Usage: tcache_demo [num_threads] [--perf]
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--perf") {
+      perf = true;
+    } else {
+      num_threads = std::atoi(argv[i]);
+    }
   }
 
   std::cout << "=== Thread Cache (tcache) Performance Demo ===" << std::endl;
@@ -75,13 +86,18 @@ int main(int argc, char* argv[]) {
 
   // Run the benchmark
   std::cout << "Running benchmark..." << std::flush;
-  double elapsed = RunBenchmark(num_threads, kIterations);
+  std::unique_ptr<PerfCounters> counters;
+  if (perf) {
+    counters = std::make_unique<PerfCounters>();
+  }
+  BenchmarkMeasurement measure = RunBenchmark(num_threads, kIterations, counters.get());
   std::cout << " Done!" << std::endl;
   std::cout << std::endl;
 
   // Calculate and display results
-  double total_ops = num_threads * kIterations;
-  double ops_per_second = total_ops / elapsed;
+  double elapsed = measure.seconds();
+  double total_ops = measure.operations();
+  double ops_per_second = measure.operations_per_second();
 
   std::cout << "Results:" << std::endl;
   std::cout << "  Time elapsed: " << std::fixed << std::setprecision(3)
@@ -90,6 +106,12 @@ int main(int argc, char* argv[]) {
             << ops_per_second << std::endl;
   std::cout << "  Time per operation: " << std::fixed << std::setprecision(3)
             << (elapsed / total_ops * 1e9) << " ns" << std::endl;
+  if (counters) {
+    std::cout << "  Counters:" << measure.CounterSummary() << std::endl;
+    if (!counters->Error().empty()) {
+      std::cout << "  (unavailable: " << counters->Error() << ")" << std::endl;
+    }
+  }
 
   return 0;
 }
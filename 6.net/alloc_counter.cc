@@ -0,0 +1,35 @@
+// Copyright 2024
+// Process-wide heap allocation counter
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+}  // namespace
+
+// The array and nothrow forms default to calling these.
+void* operator new(std::size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t /*size*/) noexcept { std::free(p); }
+
+namespace net {
+
+uint64_t HeapAllocations() {
+  return g_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace net
@@ -0,0 +1,18 @@
+// Copyright 2024
+// Process-wide heap allocation counter
+
+#ifndef ALLOC_COUNTER_H_
+#define ALLOC_COUNTER_H_
+
+#include <cstdint>
+
+namespace net {
+
+// Number of calls to the global operator new so far. Linking alloc_counter.o
+// replaces the global allocation functions with counting ones; the count is
+// a relaxed atomic increment on top of malloc.
+uint64_t HeapAllocations();
+
+}  // namespace net
+
+#endif  // ALLOC_COUNTER_H_
@@ -0,0 +1,156 @@
+// Copyright 2024
+// Coalescing writer that stores message payloads in a file at their position
+
+#include "block_writer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <system_error>
+
+namespace net {
+
+BlockWriter::BlockWriter(const std::string& path,
+                         const BlockWriterOptions& options)
+    : options_(options), last_sync_(Clock::now()) {
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Failed to open " + path);
+  }
+}
+
+BlockWriter::~BlockWriter() {
+  try {
+    Sync();
+  } catch (const std::system_error& e) {
+    std::cerr << "Error syncing block file: " << e.what() << std::endl;
+  }
+  close(fd_);
+}
+
+void BlockWriter::Write(uint64_t position, const uint8_t* data,
+                        size_t length) {
+  ++stats_.messages;
+  stats_.bytes_received += length;
+  if (length == 0) {
+    return;
+  }
+  if (buffered_bytes_ == 0) {
+    first_buffered_ = Clock::now();
+  }
+
+  const uint64_t end = position + length;
+
+  // Find the first extent that overlaps or touches [position, end).
+  auto it = extents_.upper_bound(position);
+  if (it != extents_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.size() >= position) {
+      it = prev;
+    }
+  }
+
+  if (it == extents_.end() || it->first > end) {
+    extents_.emplace_hint(it, position,
+                          std::vector<uint8_t>(data, data + length));
+    buffered_bytes_ += length;
+  } else {
+    // Merge every extent in reach into one buffer starting at `start`. When
+    // the first extent already starts there (the sequential-append case) its
+    // buffer is reused and simply grows.
+    const uint64_t start = std::min(it->first, position);
+    std::vector<uint8_t> merged;
+    if (it->first == start) {
+      buffered_bytes_ -= it->second.size();
+      merged = std::move(it->second);
+      it = extents_.erase(it);
+    }
+    while (it != extents_.end() && it->first <= end) {
+      const size_t offset = it->first - start;
+      if (merged.size() < offset + it->second.size()) {
+        merged.resize(offset + it->second.size());
+      }
+      std::memcpy(merged.data() + offset, it->second.data(),
+                  it->second.size());
+      buffered_bytes_ -= it->second.size();
+      it = extents_.erase(it);
+    }
+    if (merged.size() < end - start) {
+      merged.resize(end - start);
+    }
+    std::memcpy(merged.data() + (position - start), data, length);
+    buffered_bytes_ += merged.size();
+    extents_.emplace_hint(it, start, std::move(merged));
+  }
+
+  if (buffered_bytes_ >= options_.flush_bytes) {
+    Flush();
+  }
+}
+
+void BlockWriter::Poll() {
+  auto now = Clock::now();
+  if (buffered_bytes_ > 0 &&
+      now - first_buffered_ >= options_.flush_interval) {
+    Flush();
+  }
+  if (unsynced_bytes_ > 0 && now - last_sync_ >= options_.sync_interval) {
+    Sync();
+  }
+}
+
+void BlockWriter::Flush() {
+  for (const auto& [position, data] : extents_) {
+    WriteExtent(position, data);
+  }
+  extents_.clear();
+  buffered_bytes_ = 0;
+
+  if (unsynced_bytes_ >= options_.sync_bytes) {
+    Sync();
+  }
+}
+
+void BlockWriter::Sync() {
+  if (buffered_bytes_ > 0) {
+    Flush();
+  }
+  if (unsynced_bytes_ == 0) {
+    return;
+  }
+  if (fdatasync(fd_) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Failed to sync block file");
+  }
+  ++stats_.syncs;
+  unsynced_bytes_ = 0;
+  last_sync_ = Clock::now();
+}
+
+void BlockWriter::WriteExtent(uint64_t position,
+                              const std::vector<uint8_t>& data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t ret = pwrite(fd_, data.data() + done, data.size() - done,
+                         static_cast<off_t>(position + done));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "Failed to write block file");
+    }
+    done += static_cast<size_t>(ret);
+    ++stats_.pwrites;
+  }
+  stats_.bytes_written += data.size();
+  unsynced_bytes_ += data.size();
+}
+
+}  // namespace net
@@ -0,0 +1,85 @@
+// Copyright 2024
+// Coalescing writer that stores message payloads in a file at their position
+
+#ifndef BLOCK_WRITER_H_
+#define BLOCK_WRITER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace net {
+
+struct BlockWriterOptions {
+  // Flush buffered extents once this many bytes are pending
+  size_t flush_bytes = 8 << 20;
+  // ... or once the oldest pending byte is this old
+  std::chrono::milliseconds flush_interval{100};
+  // fdatasync() after this many bytes have been written since the last sync
+  size_t sync_bytes = 64 << 20;
+  // ... or after this much time has passed since the last sync
+  std::chrono::milliseconds sync_interval{1000};
+};
+
+struct BlockWriterStats {
+  uint64_t bytes_received = 0;
+  uint64_t messages = 0;
+  uint64_t bytes_written = 0;
+  uint64_t pwrites = 0;
+  uint64_t syncs = 0;
+};
+
+// Treats MessageHeader::position as a byte offset in a backing file.
+//
+// Incoming payloads are kept in an in-memory extent map: non-overlapping,
+// non-adjacent ranges keyed by their start offset. A payload that touches or
+// overlaps existing extents is merged into them (newer bytes win), so a
+// stream of small, possibly out-of-order messages turns into a few large
+// sequential pwrite() calls. Durability is batched with fdatasync().
+//
+// Throws std::system_error on I/O errors.
+class BlockWriter {
+ public:
+  BlockWriter(const std::string& path, const BlockWriterOptions& options);
+
+  // Flushes and syncs everything that is still buffered.
+  ~BlockWriter();
+
+  BlockWriter(const BlockWriter&) = delete;
+  BlockWriter& operator=(const BlockWriter&) = delete;
+
+  // Buffers a payload; may flush and sync if a size threshold is reached.
+  void Write(uint64_t position, const uint8_t* data, size_t length);
+
+  // Applies the time-based thresholds. Call periodically.
+  void Poll();
+
+  // Writes all buffered extents to the file.
+  void Flush();
+
+  // Flush() followed by fdatasync().
+  void Sync();
+
+  const BlockWriterStats& stats() const { return stats_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void WriteExtent(uint64_t position, const std::vector<uint8_t>& data);
+
+  int fd_;
+  BlockWriterOptions options_;
+  std::map<uint64_t, std::vector<uint8_t>> extents_;
+  size_t buffered_bytes_ = 0;
+  size_t unsynced_bytes_ = 0;
+  Clock::time_point first_buffered_;
+  Clock::time_point last_sync_;
+  BlockWriterStats stats_;
+};
+
+}  // namespace net
+
+#endif  // BLOCK_WRITER_H_
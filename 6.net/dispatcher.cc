@@ -0,0 +1,152 @@
+// Copyright 2024
+// Hands batches of received messages from the I/O thread to worker threads
+
+#include "dispatcher.h"
+
+#include <cstring>
+#include <iomanip>
+
+namespace net {
+
+namespace {
+
+// Polls of an empty queue before a worker goes to sleep
+constexpr int kSpinCount = 200;
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+}  // namespace
+
+Dispatcher::Dispatcher(Handler handler, const DispatcherOptions& options)
+    : handler_(std::move(handler)) {
+  for (size_t i = 0; i < options.workers; ++i) {
+    workers_.push_back(std::make_unique<Worker>(options.queue_depth));
+  }
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->thread = std::thread(&Dispatcher::Run, this, i);
+  }
+}
+
+Dispatcher::~Dispatcher() { Stop(); }
+
+Batch Dispatcher::AcquireBuffer(size_t worker) {
+  if (auto batch = workers_[worker]->free_buffers.TryPop()) {
+    batch->size = 0;
+    return std::move(*batch);
+  }
+  return Batch();
+}
+
+bool Dispatcher::TryDispatch(size_t worker, Batch& batch) {
+  Worker& w = *workers_[worker];
+  size_t depth = w.queue.size();
+  if (!w.queue.TryPush(batch)) {
+    return false;
+  }
+  DispatchStats& stats = w.dispatch_stats;
+  ++stats.batches;
+  stats.depth_sum += depth;
+  stats.max_depth = std::max(stats.max_depth, depth + 1);
+
+  // Pairs with the fence in Run(): either the worker sees the new batch or
+  // we see it sleeping. Clearing the flag leaves a single wakeup syscall per
+  // sleep, however many batches arrive while the worker gets going.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (w.sleeping.load(std::memory_order_relaxed) &&
+      w.sleeping.exchange(0, std::memory_order_relaxed)) {
+    w.wake_seq.fetch_add(1, std::memory_order_relaxed);
+    w.wake_seq.notify_one();
+    ++stats.wakeups;
+  }
+  return true;
+}
+
+void Dispatcher::RecordStall(size_t worker, std::chrono::nanoseconds duration) {
+  DispatchStats& stats = workers_[worker]->dispatch_stats;
+  ++stats.stalls;
+  stats.stall_time += duration;
+}
+
+void Dispatcher::Stop() {
+  if (stopping_.exchange(true)) {
+    return;
+  }
+  for (auto& w : workers_) {
+    w->wake_seq.fetch_add(1, std::memory_order_seq_cst);
+    w->wake_seq.notify_one();
+  }
+  for (auto& w : workers_) {
+    w->thread.join();
+  }
+}
+
+void Dispatcher::Run(size_t index) {
+  Worker& w = *workers_[index];
+  int idle = 0;
+  while (true) {
+    if (auto batch = w.queue.TryPop()) {
+      Process(index, *batch);
+      // Dropped (freed) if the I/O thread holds plenty already
+      w.free_buffers.TryPush(*batch);
+      idle = 0;
+      continue;
+    }
+    if (stopping_.load(std::memory_order_acquire) && w.queue.size() == 0) {
+      return;
+    }
+    if (++idle < kSpinCount) {
+      CpuRelax();
+      continue;
+    }
+
+    uint32_t seq = w.wake_seq.load(std::memory_order_seq_cst);
+    w.sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (w.queue.size() == 0 && !stopping_.load(std::memory_order_acquire)) {
+      ++w.worker_stats.sleeps;
+      w.wake_seq.wait(seq, std::memory_order_seq_cst);
+    }
+    w.sleeping.store(0, std::memory_order_relaxed);
+    idle = 0;
+  }
+}
+
+void Dispatcher::Process(size_t index, const Batch& batch) {
+  WorkerStats& stats = workers_[index]->worker_stats;
+  const uint8_t* data = batch.data.get();
+  size_t offset = 0;
+  while (offset < batch.size) {
+    MessageHeader header;
+    std::memcpy(&header, data + offset, sizeof(header));
+    handler_(index, header, data + offset + sizeof(MessageHeader));
+    offset += sizeof(MessageHeader) + header.length;
+    ++stats.messages;
+  }
+  stats.bytes += batch.size;
+}
+
+void Dispatcher::PrintStats(std::ostream& out) const {
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    const DispatchStats& d = workers_[i]->dispatch_stats;
+    const WorkerStats& w = workers_[i]->worker_stats;
+    out << "Worker " << i << ": " << w.messages << " messages in "
+        << d.batches << " batches";
+    if (d.batches > 0) {
+      out << std::fixed << std::setprecision(1) << " (avg "
+          << static_cast<double>(w.bytes) / d.batches
+          << " bytes), queue depth avg "
+          << static_cast<double>(d.depth_sum) / d.batches << " max "
+          << d.max_depth;
+    }
+    out << ", " << d.stalls << " read stalls ("
+        << std::chrono::duration<double, std::milli>(d.stall_time).count()
+        << " ms), " << w.sleeps << " sleeps, " << d.wakeups << " wakeups"
+        << std::endl;
+  }
+}
+
+}  // namespace net
@@ -0,0 +1,142 @@
+// Copyright 2024
+// Hands batches of received messages from the I/O thread to worker threads
+
+#ifndef DISPATCHER_H_
+#define DISPATCHER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "message.h"
+#include "spsc_queue.h"
+
+namespace net {
+
+struct DispatcherOptions {
+  size_t workers = 4;
+  // Batches queued per worker before TryDispatch() fails and the I/O thread
+  // has to stop reading (a power of two)
+  size_t queue_depth = 64;
+};
+
+// A buffer of complete MessageHeader + data records.
+struct Batch {
+  Batch() = default;
+  Batch(Batch&& other) noexcept { *this = std::move(other); }
+  Batch& operator=(Batch&& other) noexcept {
+    data = std::move(other.data);
+    capacity = std::exchange(other.capacity, 0);
+    size = std::exchange(other.size, 0);
+    return *this;
+  }
+
+  std::unique_ptr<uint8_t[]> data;
+  size_t capacity = 0;
+  size_t size = 0;
+
+  // Grows to at least `bytes`, keeping the first `size` bytes.
+  void Reserve(size_t bytes) {
+    if (capacity < bytes) {
+      auto grown = std::make_unique_for_overwrite<uint8_t[]>(bytes);
+      if (size > 0) {
+        std::memcpy(grown.get(), data.get(), size);
+      }
+      data = std::move(grown);
+      capacity = bytes;
+    }
+  }
+};
+
+// Runs a handler for received messages on a pool of worker threads. The
+// I/O thread (a single producer) sends every batch of a connection to the
+// same worker, over a lock-free SPSC queue per worker, so messages of one
+// connection are handled in order while connections are spread over the
+// pool. Batch buffers travel back over a second queue per worker and are
+// reused, so the steady state does not allocate.
+//
+// Workers spin briefly on an empty queue and then sleep on a futex
+// (std::atomic::wait); the I/O thread only makes the wakeup syscall when the
+// worker is actually asleep.
+class Dispatcher {
+ public:
+  using Handler = std::function<void(size_t worker, const MessageHeader&,
+                                     const uint8_t* data)>;
+
+  Dispatcher(Handler handler, const DispatcherOptions& options);
+
+  // Stop()s if not done yet.
+  ~Dispatcher();
+
+  Dispatcher(const Dispatcher&) = delete;
+  Dispatcher& operator=(const Dispatcher&) = delete;
+
+  size_t workers() const { return workers_.size(); }
+
+  // I/O thread: an empty buffer, recycled from `worker` if possible.
+  Batch AcquireBuffer(size_t worker);
+
+  // I/O thread: queues `batch` for `worker`. Returns false, leaving the
+  // batch in place, if the worker's queue is full.
+  bool TryDispatch(size_t worker, Batch& batch);
+
+  // I/O thread: accounts for time the reads feeding `worker` were paused
+  // waiting for queue space.
+  void RecordStall(size_t worker, std::chrono::nanoseconds duration);
+
+  // Handles everything queued so far and joins the workers.
+  void Stop();
+
+  // Per worker queue depth, stall and wakeup counters. Call after Stop().
+  void PrintStats(std::ostream& out) const;
+
+ private:
+  // Written by the I/O thread
+  struct DispatchStats {
+    uint64_t batches = 0;
+    uint64_t depth_sum = 0;  // Queue depth seen by every dispatch
+    size_t max_depth = 0;
+    uint64_t stalls = 0;
+    std::chrono::nanoseconds stall_time{0};
+    uint64_t wakeups = 0;
+  };
+
+  // Written by the worker thread
+  struct WorkerStats {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t sleeps = 0;
+  };
+
+  struct alignas(64) Worker {
+    explicit Worker(size_t queue_depth)
+        : queue(queue_depth), free_buffers(queue_depth * 2) {}
+
+    SpscQueue<Batch> queue;         // I/O thread -> worker
+    SpscQueue<Batch> free_buffers;  // worker -> I/O thread
+    alignas(64) std::atomic<uint32_t> wake_seq{0};
+    std::atomic<uint32_t> sleeping{0};
+    DispatchStats dispatch_stats;
+    alignas(64) WorkerStats worker_stats;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+  void Process(size_t index, const Batch& batch);
+
+  Handler handler_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> stopping_{false};
+};
+
+}  // namespace net
+
+#endif  // DISPATCHER_H_
@@ -0,0 +1,109 @@
+// Copyright 2024
+// Batch compression of message streams into deflate frames
+
+#include "frame_codec.h"
+
+#include <time.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace net {
+
+namespace {
+
+// One clock_gettime() pair per frame, not per message.
+std::chrono::nanoseconds ThreadCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+[[noreturn]] void ThrowZlib(const char* what, int ret, const z_stream& s) {
+  throw std::runtime_error(std::string(what) + " failed: " +
+                           (s.msg ? s.msg : std::to_string(ret)));
+}
+
+}  // namespace
+
+FrameCompressor::FrameCompressor(const CompressionOptions& options) {
+  std::memset(&stream_, 0, sizeof(stream_));
+  int ret = deflateInit(&stream_, options.level);
+  if (ret != Z_OK) {
+    ThrowZlib("deflateInit", ret, stream_);
+  }
+  raw_.reserve(options.max_frame_bytes);
+}
+
+FrameCompressor::~FrameCompressor() { deflateEnd(&stream_); }
+
+void FrameCompressor::Add(const void* data, size_t size) {
+  auto* bytes = static_cast<const uint8_t*>(data);
+  raw_.insert(raw_.end(), bytes, bytes + size);
+}
+
+const std::vector<uint8_t>& FrameCompressor::Finish() {
+  auto cpu_start = ThreadCpuTime();
+
+  // deflateBound() covers a Z_FINISH; a sync flush adds at most an empty
+  // stored block and a few bits.
+  size_t bound = deflateBound(&stream_, raw_.size()) + 16;
+  frame_.resize(sizeof(FrameHeader) + bound);
+  stream_.next_in = raw_.data();
+  stream_.avail_in = static_cast<uInt>(raw_.size());
+  stream_.next_out = frame_.data() + sizeof(FrameHeader);
+  stream_.avail_out = static_cast<uInt>(bound);
+  int ret = deflate(&stream_, Z_SYNC_FLUSH);
+  if (ret != Z_OK || stream_.avail_in != 0 || stream_.avail_out == 0) {
+    ThrowZlib("deflate", ret, stream_);
+  }
+
+  FrameHeader header;
+  header.compressed_length = static_cast<uint32_t>(bound - stream_.avail_out);
+  header.raw_length = static_cast<uint32_t>(raw_.size());
+  std::memcpy(frame_.data(), &header, sizeof(header));
+  frame_.resize(sizeof(FrameHeader) + header.compressed_length);
+
+  ++stats_.frames;
+  stats_.raw_bytes += raw_.size();
+  stats_.wire_bytes += frame_.size();
+  stats_.cpu_time += ThreadCpuTime() - cpu_start;
+  raw_.clear();
+  return frame_;
+}
+
+FrameDecompressor::FrameDecompressor(CodecStats* stats) : stats_(stats) {
+  std::memset(&stream_, 0, sizeof(stream_));
+  int ret = inflateInit(&stream_);
+  if (ret != Z_OK) {
+    ThrowZlib("inflateInit", ret, stream_);
+  }
+}
+
+FrameDecompressor::~FrameDecompressor() { inflateEnd(&stream_); }
+
+void FrameDecompressor::Decompress(const FrameHeader& header,
+                                   const uint8_t* body,
+                                   std::vector<uint8_t>* raw) {
+  auto cpu_start = ThreadCpuTime();
+
+  raw->resize(header.raw_length);
+  stream_.next_in = const_cast<uint8_t*>(body);
+  stream_.avail_in = header.compressed_length;
+  stream_.next_out = raw->data();
+  stream_.avail_out = header.raw_length;
+  // The frame ends on a sync flush, so all of it is consumed and produced.
+  int ret = inflate(&stream_, Z_SYNC_FLUSH);
+  if ((ret != Z_OK && ret != Z_BUF_ERROR) || stream_.avail_in != 0 ||
+      stream_.avail_out != 0) {
+    ThrowZlib("inflate", ret, stream_);
+  }
+
+  ++stats_->frames;
+  stats_->raw_bytes += header.raw_length;
+  stats_->wire_bytes += sizeof(FrameHeader) + header.compressed_length;
+  stats_->cpu_time += ThreadCpuTime() - cpu_start;
+}
+
+}  // namespace net
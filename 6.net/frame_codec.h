@@ -0,0 +1,97 @@
+// Copyright 2024
+// Batch compression of message streams into deflate frames
+
+#ifndef FRAME_CODEC_H_
+#define FRAME_CODEC_H_
+
+#include <zlib.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "message.h"
+
+namespace net {
+
+struct CompressionOptions {
+  // zlib level: 1 is fastest, 9 compresses best
+  int level = 1;
+  // Raw bytes batched into one frame; only a single larger message makes a
+  // frame exceed it.
+  size_t max_frame_bytes = 64 << 10;
+  // Longest time the first message of a frame may wait for the frame to be
+  // sent. Only checked in Sender::Send() and Sender::Poll(), so a sender
+  // that goes idle without calling Poll() can hold a frame past it.
+  std::chrono::microseconds max_delay{1000};
+};
+
+struct CodecStats {
+  uint64_t frames = 0;
+  uint64_t raw_bytes = 0;
+  // Including the FrameHeader of every frame
+  uint64_t wire_bytes = 0;
+  // Thread CPU time spent in deflate() or inflate()
+  std::chrono::nanoseconds cpu_time{0};
+};
+
+// Packs a stream of messages into FrameHeader-prefixed deflate frames. One
+// deflate stream spans the whole connection and every frame ends with a
+// sync flush, so each frame is decodable on arrival while later frames are
+// still compressed against the history (up to 32 KiB) of earlier ones, the
+// way a per-connection dictionary would be.
+//
+// Throws std::runtime_error on zlib errors.
+class FrameCompressor {
+ public:
+  explicit FrameCompressor(const CompressionOptions& options);
+  ~FrameCompressor();
+
+  FrameCompressor(const FrameCompressor&) = delete;
+  FrameCompressor& operator=(const FrameCompressor&) = delete;
+
+  // Appends raw bytes to the current frame (copied; compression happens in
+  // Finish()).
+  void Add(const void* data, size_t size);
+
+  // Raw bytes in the current frame.
+  size_t pending_bytes() const { return raw_.size(); }
+
+  // Compresses the current frame and returns it, header included. The
+  // result stays valid until the next call to Add().
+  const std::vector<uint8_t>& Finish();
+
+  const CodecStats& stats() const { return stats_; }
+
+ private:
+  z_stream stream_;
+  std::vector<uint8_t> raw_;
+  std::vector<uint8_t> frame_;
+  CodecStats stats_;
+};
+
+// Receiving side of FrameCompressor, with one instance per connection.
+//
+// Throws std::runtime_error on corrupt frames.
+class FrameDecompressor {
+ public:
+  // Work is accounted in `stats`, which may be shared between instances.
+  explicit FrameDecompressor(CodecStats* stats);
+  ~FrameDecompressor();
+
+  FrameDecompressor(const FrameDecompressor&) = delete;
+  FrameDecompressor& operator=(const FrameDecompressor&) = delete;
+
+  // Inflates the body of a frame into `raw` (resized to header.raw_length).
+  void Decompress(const FrameHeader& header, const uint8_t* body,
+                  std::vector<uint8_t>* raw);
+
+ private:
+  z_stream stream_;
+  CodecStats* stats_;
+};
+
+}  // namespace net
+
+#endif  // FRAME_CODEC_H_
@@ -15,6 +15,23 @@ struct MessageHeader {
   uint32_t length;    // Length of following data
 } __attribute__((packed));
 
+// Sent back on the same connection by a receiver running with acks
+// enabled (optional flow control). Cumulative: every message with a
+// position up to and including `position` has been processed, so senders
+// using it must send increasing positions on a connection.
+struct AckMessage {
+  uint64_t position;
+} __attribute__((packed));
+
+// Prefix of a compressed frame on a stream negotiated out of band
+// (tcp_sender --compress, tcp_receiver --compressed). The frame body is
+// `compressed_length` bytes of deflate data that inflate to `raw_length`
+// bytes of ordinary MessageHeader + data records.
+struct FrameHeader {
+  uint32_t compressed_length;
+  uint32_t raw_length;
+} __attribute__((packed));
+
 // Complete message with header and data
 struct Message {
   MessageHeader header;
@@ -0,0 +1,92 @@
+// Copyright 2024
+// Incremental parser for a byte stream of framed messages
+
+#ifndef MESSAGE_PARSER_H_
+#define MESSAGE_PARSER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "message.h"
+
+namespace net {
+
+// Splits an arbitrarily chunked stream of MessageHeader + data records into
+// messages. Complete messages are handed out straight from the input chunk;
+// only a message straddling two chunks is copied into an internal buffer.
+class MessageParser {
+ public:
+  // Calls handler(const MessageHeader&, const uint8_t* data) for every
+  // message completed by this chunk. The data pointer is valid only for the
+  // duration of the call.
+  template <typename Handler>
+  void Feed(const uint8_t* data, size_t size, Handler&& handler) {
+    if (!partial_.empty()) {
+      size_t used = FillPartial(data, size);
+      data += used;
+      size -= used;
+      if (!PartialComplete()) {
+        return;
+      }
+      handler(PartialHeader(), partial_.data() + sizeof(MessageHeader));
+      partial_.clear();
+    }
+
+    while (size >= sizeof(MessageHeader)) {
+      MessageHeader header;
+      std::memcpy(&header, data, sizeof(header));
+      size_t total = sizeof(MessageHeader) + header.length;
+      if (size < total) {
+        break;
+      }
+      handler(header, data + sizeof(MessageHeader));
+      data += total;
+      size -= total;
+    }
+
+    partial_.assign(data, data + size);
+  }
+
+  // True if the stream ended in the middle of a message.
+  bool HasPartial() const { return !partial_.empty(); }
+
+ private:
+  MessageHeader PartialHeader() const {
+    MessageHeader header;
+    std::memcpy(&header, partial_.data(), sizeof(header));
+    return header;
+  }
+
+  size_t PartialTarget() const {
+    if (partial_.size() < sizeof(MessageHeader)) {
+      return sizeof(MessageHeader);
+    }
+    return sizeof(MessageHeader) + PartialHeader().length;
+  }
+
+  bool PartialComplete() const {
+    return partial_.size() >= sizeof(MessageHeader) &&
+           partial_.size() == PartialTarget();
+  }
+
+  // Moves bytes from the input into the partial message; the header is
+  // completed first so that the full target length is known.
+  size_t FillPartial(const uint8_t* data, size_t size) {
+    size_t used = 0;
+    while (used < size && !PartialComplete()) {
+      size_t n = std::min(size - used, PartialTarget() - partial_.size());
+      partial_.insert(partial_.end(), data + used, data + used + n);
+      used += n;
+    }
+    return used;
+  }
+
+  std::vector<uint8_t> partial_;
+};
+
+}  // namespace net
+
+#endif  // MESSAGE_PARSER_H_
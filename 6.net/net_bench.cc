@@ -0,0 +1,516 @@
+// Copyright 2024
+// Loopback throughput/latency matrix: payload size x connections x receiver
+// threads, written as CSV
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+// Boost 1.74's awaitable.hpp uses std::exchange without including <utility>
+#include <utility>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_measurement.h"
+#include "message.h"
+#include "message_parser.h"
+#include "uring_server.h"
+
+namespace net {
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+// Latency histogram with 16 linear sub-buckets per power of two (about 6%
+// relative error), covering 1 ns to several minutes.
+class LatencyHistogram {
+ public:
+  void Record(int64_t ns) {
+    ++counts_[BucketOf(ns < 1 ? 1 : static_cast<uint64_t>(ns))];
+    ++total_;
+    max_ = std::max(max_, ns);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  // Upper bound of the bucket holding the q-quantile, in ns.
+  int64_t Percentile(double q) const {
+    if (total_ == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * (total_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min<int64_t>(UpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  int64_t max() const { return max_; }
+
+ private:
+  static constexpr int kSubBits = 4;
+  static constexpr size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+  static size_t BucketOf(uint64_t v) {
+    if (v < (1u << kSubBits)) {
+      return v;
+    }
+    int exp = 63 - __builtin_clzll(v) - kSubBits + 1;
+    return (static_cast<size_t>(exp) << kSubBits) +
+           ((v >> (exp - 1)) & ((1u << kSubBits) - 1));
+  }
+
+  static int64_t UpperBound(size_t bucket) {
+    if (bucket < (1u << kSubBits)) {
+      return static_cast<int64_t>(bucket);
+    }
+    int exp = static_cast<int>(bucket >> kSubBits);
+    uint64_t sub = bucket & ((1u << kSubBits) - 1);
+    return static_cast<int64_t>((((1ull << kSubBits) | sub) + 1)
+                                << (exp - 1)) - 1;
+  }
+
+  uint64_t counts_[kBuckets] = {};
+  uint64_t total_ = 0;
+  int64_t max_ = 0;
+};
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch()).count();
+}
+
+// What one receiver thread saw. Senders put their send time (steady clock,
+// ns) into the first 8 bytes of every payload.
+struct ReceiverStats {
+  uint64_t messages = 0;
+  uint64_t bytes = 0;
+  LatencyHistogram latency;
+  double cpu_seconds = 0;  // RUSAGE_THREAD of the receiver thread
+
+  void Record(const MessageHeader& header, const uint8_t* data) {
+    int64_t sent;
+    std::memcpy(&sent, data, sizeof(sent));
+    latency.Record(NowNs() - sent);
+    ++messages;
+    bytes += header.length;
+  }
+};
+
+// One receiver thread: a listener on its own port and the connections to
+// it, on either backend. `received` is bumped after every chunk so that the
+// driver can tell when everything has arrived. Setup errors (e.g. the port
+// being taken) are caught in the thread and reported through error().
+class ReceiverThread {
+ public:
+  ReceiverThread(const std::string& backend, uint16_t port,
+                 std::atomic<uint64_t>* received)
+      : backend_(backend), port_(port), received_(received) {
+    thread_ = std::thread([this] { Run(); });
+    while (!ready_.load()) {
+      std::this_thread::yield();
+    }
+  }
+
+  void Stop() {
+    if (uring_) {
+      uring_->Stop();
+    } else {
+      io_context_.stop();
+    }
+    thread_.join();
+  }
+
+  const ReceiverStats& stats() const { return stats_; }
+
+  // Empty unless the listener could not be set up
+  const std::string& error() const { return error_; }
+
+ private:
+  // Same framing as tcp_receiver's sessions, reading whatever is available
+  // and parsing it in place.
+  class Session : public std::enable_shared_from_this<Session> {
+   public:
+    Session(tcp::socket socket, ReceiverThread* owner)
+        : socket_(std::move(socket)), owner_(owner), buffer_(64 << 10) {}
+
+    void Read() {
+      auto self = shared_from_this();
+      socket_.async_read_some(
+          boost::asio::buffer(buffer_),
+          [this, self](boost::system::error_code ec, std::size_t length) {
+            if (ec) {
+              return;
+            }
+            owner_->Consume(&parser_, buffer_.data(), length);
+            Read();
+          });
+    }
+
+   private:
+    tcp::socket socket_;
+    ReceiverThread* owner_;
+    MessageParser parser_;
+    std::vector<uint8_t> buffer_;
+  };
+
+  void Consume(MessageParser* parser, const uint8_t* data, size_t size) {
+    uint64_t before = stats_.messages;
+    parser->Feed(data, size, [this](const MessageHeader& header,
+                                    const uint8_t* payload) {
+      stats_.Record(header, payload);
+    });
+    received_->fetch_add(stats_.messages - before, std::memory_order_relaxed);
+  }
+
+  void Accept(tcp::acceptor* acceptor) {
+    acceptor->async_accept(
+        [this, acceptor](boost::system::error_code ec, tcp::socket socket) {
+          if (!ec) {
+            socket.set_option(tcp::no_delay(true));
+            std::make_shared<Session>(std::move(socket), this)->Read();
+            Accept(acceptor);
+          }
+        });
+  }
+
+  void Run() {
+    try {
+      Serve();
+    } catch (const std::exception& e) {
+      if (ready_.load()) {
+        std::cerr << "Receiver on port " << port_ << " failed: " << e.what()
+                  << std::endl;
+      } else {
+        error_ = "port " + std::to_string(port_) + ": " + e.what();
+        ready_.store(true);
+      }
+    }
+  }
+
+  void Serve() {
+    rusage start;
+    getrusage(RUSAGE_THREAD, &start);
+    if (backend_ == "uring") {
+      UringServerOptions options;
+      options.log_connections = false;  // Keep stdout clean for the CSV
+      UringServer server(
+          port_,
+          [this](const MessageHeader& header, const uint8_t* data) {
+            stats_.Record(header, data);
+            received_->fetch_add(1, std::memory_order_relaxed);
+          },
+          options);
+      uring_ = &server;
+      ready_.store(true);
+      // A tick bounds every wait, so Stop() from another thread (rather
+      // than a signal handler) is noticed within 10 ms.
+      server.Run([] {});
+    } else {
+      tcp::acceptor acceptor(io_context_, tcp::endpoint(tcp::v4(), port_));
+      Accept(&acceptor);
+      ready_.store(true);
+      io_context_.run();
+    }
+    rusage end;
+    getrusage(RUSAGE_THREAD, &end);
+    stats_.cpu_seconds = BenchmarkMeasurement::CpuSeconds(start, end);
+  }
+
+  std::string backend_;
+  uint16_t port_;
+  std::atomic<uint64_t>* received_;
+  boost::asio::io_context io_context_;
+  UringServer* uring_ = nullptr;
+  ReceiverStats stats_;
+  std::atomic<bool> ready_{false};
+  std::string error_;
+  std::thread thread_;
+};
+
+// Sends back-to-back messages for `duration`, as fast as the connection
+// takes them. Returns the number sent.
+uint64_t RunSender(uint16_t port, uint32_t payload_size,
+                   std::chrono::milliseconds duration) {
+  boost::asio::io_context io_context;
+  tcp::socket socket(io_context);
+  socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+  socket.set_option(tcp::no_delay(true));
+
+  std::vector<uint8_t> payload(payload_size);
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = static_cast<uint8_t>(i);
+  }
+  MessageHeader header;
+  header.length = payload_size;
+  std::array<boost::asio::const_buffer, 2> buffers = {
+      boost::asio::buffer(&header, sizeof(header)),
+      boost::asio::buffer(payload)};
+
+  uint64_t sent = 0;
+  auto end = Clock::now() + duration;
+  // Checking the clock every message would cost as much as a small send.
+  while ((sent & 0xf) != 0 || Clock::now() < end) {
+    header.position = sent * payload_size;
+    int64_t now = NowNs();
+    std::memcpy(payload.data(), &now, sizeof(now));
+    boost::asio::write(socket, buffers);
+    ++sent;
+  }
+  return sent;
+}
+
+struct BenchConfig {
+  std::string backend = "asio";
+  uint16_t base_port = 9100;
+  std::chrono::milliseconds duration{1000};
+  std::vector<uint32_t> payload_sizes = {16, 256, 4096, 65536, 1 << 20};
+  std::vector<int> connection_counts = {1, 4, 16};
+  std::vector<int> thread_counts = {1, 2, 4};
+};
+
+void PrintCsvHeader(std::ostream& out) {
+  out << "backend,payload_bytes,connections,threads,messages,seconds,"
+      << "msgs_per_sec,gbit_per_sec,cpu_pct,receiver_cpu_pct,"
+      << "p50_us,p90_us,p99_us,p999_us,max_us" << std::endl;
+}
+
+// One point of the matrix: `threads` receiver threads on consecutive ports
+// from `first_port`, `connections` sender threads spread over them. Returns
+// false, with nothing written to `out`, if a receiver could not listen.
+bool RunPoint(const BenchConfig& config, uint16_t first_port,
+              uint32_t payload_size, int connections, int threads,
+              std::ostream& out) {
+  std::atomic<uint64_t> received{0};
+  std::vector<std::unique_ptr<ReceiverThread>> receivers;
+  bool listening = true;
+  for (int t = 0; t < threads; ++t) {
+    receivers.push_back(std::make_unique<ReceiverThread>(
+        config.backend, static_cast<uint16_t>(first_port + t), &received));
+    if (!receivers.back()->error().empty()) {
+      std::cerr << "Cannot listen on " << receivers.back()->error()
+                << std::endl;
+      listening = false;
+      break;
+    }
+  }
+  if (!listening) {
+    for (auto& receiver : receivers) {
+      receiver->Stop();
+    }
+    return false;
+  }
+
+  BenchmarkMeasurement measure;
+  measure.Start();
+
+  std::atomic<uint64_t> sent{0};
+  std::vector<std::thread> senders;
+  for (int c = 0; c < connections; ++c) {
+    senders.emplace_back([&, c] {
+      sent += RunSender(static_cast<uint16_t>(first_port + c % threads),
+                        payload_size, config.duration);
+    });
+  }
+  for (auto& sender : senders) {
+    sender.join();
+  }
+  // Drain what is still in flight (bounded, in case something broke).
+  auto give_up = Clock::now() + std::chrono::seconds(10);
+  while (received.load() < sent.load() && Clock::now() < give_up) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  measure.Stop();
+
+  ReceiverStats total;
+  double receiver_cpu = 0;
+  for (auto& receiver : receivers) {
+    receiver->Stop();
+    const ReceiverStats& stats = receiver->stats();
+    total.messages += stats.messages;
+    total.bytes += stats.bytes;
+    total.latency.Merge(stats.latency);
+    receiver_cpu += stats.cpu_seconds;
+  }
+  if (total.messages != sent.load()) {
+    std::cerr << "Warning: sent " << sent.load() << " messages, received "
+              << total.messages << std::endl;
+  }
+
+  double seconds = measure.seconds();
+  auto us = [&total](double q) {
+    return total.latency.Percentile(q) / 1e3;
+  };
+  out << config.backend << "," << payload_size << "," << connections << ","
+      << threads << "," << total.messages << "," << std::fixed
+      << std::setprecision(3) << seconds << "," << std::setprecision(0)
+      << total.messages / seconds << "," << std::setprecision(3)
+      << total.bytes * 8 / seconds / 1e9 << "," << std::setprecision(1)
+      << measure.cpu_percent() << "," << receiver_cpu / seconds * 100.0
+      << "," << us(0.5) << "," << us(0.9) << "," << us(0.99) << ","
+      << us(0.999) << "," << total.latency.max() / 1e3 << std::endl;
+  return true;
+}
+
+template <typename T>
+std::vector<T> ParseList(const std::string& list) {
+  std::vector<T> values;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(static_cast<T>(std::stoull(item)));
+  }
+  return values;
+}
+
+}  // namespace net
+
+void PrintUsage(const char* prog_name) {
+  std::cout << "Usage: " << prog_name << " [--backend asio|uring] "
+            << "[--payloads LIST] [--connections LIST] [--threads LIST] "
+            << "[--duration-ms N] [--port N] [--csv PATH]" << std::endl;
+  std::cout << "  --payloads LIST    : Payload sizes in bytes, comma "
+            << "separated, at least 8 (default: 16,256,4096,65536,1048576)"
+            << std::endl;
+  std::cout << "  --connections LIST : Sender connections (default: 1,4,16)"
+            << std::endl;
+  std::cout << "  --threads LIST     : Receiver threads (default: 1,2,4)"
+            << std::endl;
+  std::cout << "  --duration-ms N    : Sending time per point (default: 1000)"
+            << std::endl;
+  std::cout << "  --port N           : First receiver port; each point moves "
+            << "on to fresh ones (default: 9100)" << std::endl;
+  std::cout << "  --csv PATH         : Write CSV to PATH instead of stdout"
+            << std::endl;
+  std::cout << "Latency is from the start of the send to the parse of the "
+            << "message, so it includes queueing in the sockets." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  bool all_ok = true;
+  try {
+    net::BenchConfig config;
+    std::string csv_path;
+
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--backend" && i + 1 < argc) {
+        config.backend = argv[++i];
+      } else if (arg == "--payloads" && i + 1 < argc) {
+        config.payload_sizes = net::ParseList<uint32_t>(argv[++i]);
+      } else if (arg == "--connections" && i + 1 < argc) {
+        config.connection_counts = net::ParseList<int>(argv[++i]);
+      } else if (arg == "--threads" && i + 1 < argc) {
+        config.thread_counts = net::ParseList<int>(argv[++i]);
+      } else if (arg == "--duration-ms" && i + 1 < argc) {
+        config.duration = std::chrono::milliseconds(std::stoll(argv[++i]));
+      } else if (arg == "--port" && i + 1 < argc) {
+        config.base_port = static_cast<uint16_t>(std::stoi(argv[++i]));
+      } else if (arg == "--csv" && i + 1 < argc) {
+        csv_path = argv[++i];
+      } else if (arg == "--help" || arg == "-h") {
+        PrintUsage(argv[0]);
+        return 0;
+      } else {
+        std::cerr << "Unknown argument: " << arg << std::endl;
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+    if (config.backend != "asio" && config.backend != "uring") {
+      std::cerr << "Unknown backend: " << config.backend << std::endl;
+      return 1;
+    }
+    for (int threads : config.thread_counts) {
+      if (threads <= 0) {
+        std::cerr << "Thread counts must be positive" << std::endl;
+        return 1;
+      }
+    }
+    for (int connections : config.connection_counts) {
+      if (connections <= 0) {
+        std::cerr << "Connection counts must be positive" << std::endl;
+        return 1;
+      }
+    }
+    for (uint32_t size : config.payload_sizes) {
+      if (size < sizeof(int64_t)) {
+        std::cerr << "Payloads must hold an 8-byte timestamp" << std::endl;
+        return 1;
+      }
+    }
+
+    std::ofstream csv_file;
+    if (!csv_path.empty()) {
+      csv_file.open(csv_path);
+      if (!csv_file) {
+        std::cerr << "Cannot open " << csv_path << std::endl;
+        return 1;
+      }
+    }
+    std::ostream& out = csv_path.empty() ? std::cout : csv_file;
+
+    // Every point listens on ports of its own: the previous point's
+    // connections may still sit in TIME_WAIT, and a listener torn down
+    // asynchronously may not have released its port yet.
+    int max_threads = 1;
+    for (int threads : config.thread_counts) {
+      max_threads = std::max(max_threads, threads);
+    }
+    int next_port = config.base_port;
+
+    net::PrintCsvHeader(out);
+    for (uint32_t payload_size : config.payload_sizes) {
+      for (int connections : config.connection_counts) {
+        for (int threads : config.thread_counts) {
+          if (next_port + max_threads > 65536) {
+            next_port = config.base_port;
+          }
+          uint16_t first_port = static_cast<uint16_t>(next_port);
+          next_port += threads;
+          if (!net::RunPoint(config, first_port, payload_size, connections,
+                             threads, out)) {
+            std::cerr << "Skipped: " << payload_size << " bytes, "
+                      << connections << " connections, " << threads
+                      << " threads" << std::endl;
+            all_ok = false;
+            continue;
+          }
+          if (!csv_path.empty()) {
+            std::cerr << "Done: " << payload_size << " bytes, "
+                      << connections << " connections, " << threads
+                      << " threads" << std::endl;
+          }
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+
+set -e
+
+# Compares the Boost.Asio and io_uring receiver backends over loopback.
+# Usage: ./run_backend_benchmark.sh [num_messages] [port]
+
+NUM_MESSAGES=${1:-1000000}
+PORT=${2:-8090}
+# Caps the volume per run so that large payloads do not take forever
+MAX_BYTES=$((2 * 1024 * 1024 * 1024))
+
+make tcp_receiver tcp_sender
+echo ""
+
+run_test() {
+    local backend="$1"
+    local payload_size="$2"
+    local count=$((NUM_MESSAGES * payload_size < MAX_BYTES ? NUM_MESSAGES : MAX_BYTES / payload_size))
+
+    ./tcp_receiver "$PORT" --backend "$backend" --quiet > receiver.log &
+    local receiver_pid=$!
+    sleep 0.5
+
+    ./tcp_sender localhost "$PORT" "$count" \
+        --payload-size "$payload_size" | grep "Sent"
+
+    sleep 1  # Let the receiver drain its socket buffers
+    kill -INT "$receiver_pid"
+    wait "$receiver_pid" || true
+    grep "Received" receiver.log
+}
+
+echo "============================================"
+echo "    Receiver backend comparison (loopback) "
+echo "============================================"
+echo ""
+
+for payload_size in 16 256 4096 65536; do
+    echo "=== Payload: $payload_size bytes ==="
+    for backend in asio uring; do
+        echo "$backend:"
+        run_test "$backend" "$payload_size"
+    done
+    echo "-----------------------------------------------------------"
+    echo ""
+done
+
+rm -f receiver.log
+echo "All backend tests completed!"
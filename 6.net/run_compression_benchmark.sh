@@ -0,0 +1,55 @@
+#!/bin/bash
+
+set -e
+
+# Bytes on the wire against CPU time for compressed message streams, over
+# loopback. Sweeps zlib levels and frame sizes for payloads of varying
+# randomness (0% random is the fully redundant case).
+# Usage: ./run_compression_benchmark.sh [num_messages] [payload_size] [port]
+
+NUM_MESSAGES=${1:-200000}
+PAYLOAD_SIZE=${2:-1024}
+PORT=${3:-8090}
+
+make tcp_receiver tcp_sender
+echo ""
+
+run_test() {
+    local receiver_args="$1"
+    local sender_args="$2"
+
+    ./tcp_receiver "$PORT" $receiver_args --quiet > receiver.log &
+    local receiver_pid=$!
+    sleep 0.5
+
+    ./tcp_sender localhost "$PORT" "$NUM_MESSAGES" \
+        --payload-size "$PAYLOAD_SIZE" $sender_args | grep -E "Sent|Compressed"
+
+    sleep 1  # Let the receiver drain its socket buffers
+    kill -INT "$receiver_pid"
+    wait "$receiver_pid" || true
+    grep -E "Received|Inflated" receiver.log
+}
+
+echo "============================================"
+echo "    Stream compression: CPU vs wire bytes   "
+echo "============================================"
+echo ""
+
+for random_percent in 0 50 90; do
+    echo "=== Payload: $PAYLOAD_SIZE bytes, $random_percent% random ==="
+    echo "uncompressed:"
+    run_test "" "--random-percent $random_percent"
+    for level in 1 6 9; do
+        for frame_bytes in 16384 262144; do
+            echo "level $level, $frame_bytes-byte frames:"
+            run_test "--compressed" "--random-percent $random_percent \
+                --compress $level --frame-bytes $frame_bytes"
+        done
+    done
+    echo "-----------------------------------------------------------"
+    echo ""
+done
+
+rm -f receiver.log
+echo "All compression tests completed!"
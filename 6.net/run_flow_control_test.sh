@@ -0,0 +1,65 @@
+#!/bin/bash
+
+set -e
+
+# Runs the sender against an artificially slowed receiver, with and without
+# acknowledgement-based flow control. With flow control the amount of data
+# in flight stays bounded by the window and the processed rate is stable;
+# without it the sender "finishes" early and megabytes pile up in kernel
+# socket buffers.
+# Usage: ./run_flow_control_test.sh [num_messages] [port]
+
+NUM_MESSAGES=${1:-50000}
+PORT=${2:-8090}
+PAYLOAD_SIZE=1024
+DELAY_US=50
+# Upper bound the flow-controlled run must respect (the default max window)
+MAX_IN_FLIGHT=$((64 * 1024 * 1024))
+
+make tcp_receiver tcp_sender
+echo ""
+
+# Waits until no bytes are queued on either end of connections to $PORT.
+wait_for_drain() {
+    while [ "$(ss -tnH "( sport = :$PORT or dport = :$PORT )" \
+               | awk '{s += $2 + $3} END {print s + 0}')" -gt 0 ]; do
+        sleep 0.5
+    done
+}
+
+run_test() {
+    local receiver_args="$1"
+    local sender_args="$2"
+
+    ./tcp_receiver "$PORT" --quiet --process-delay-us "$DELAY_US" \
+        $receiver_args > receiver.log &
+    local receiver_pid=$!
+    sleep 0.5
+
+    ./tcp_sender localhost "$PORT" "$NUM_MESSAGES" \
+        --payload-size "$PAYLOAD_SIZE" $sender_args | tee sender.log
+
+    # Let the receiver work through whatever is still queued in the kernel
+    wait_for_drain
+    kill -INT "$receiver_pid"
+    wait "$receiver_pid" || true
+    grep "Received" receiver.log
+}
+
+echo "=== Slow receiver (${DELAY_US} us/message), flow control ==="
+run_test "--ack" "--flow-control"
+peak=$(grep -o "peak in flight [0-9]*" sender.log | awk '{print $4}')
+echo ""
+
+echo "=== Slow receiver (${DELAY_US} us/message), no flow control ==="
+# (No acks either: a sender that exits with unread acks resets the connection)
+run_test "" ""
+echo ""
+
+rm -f receiver.log sender.log
+if [ -n "$peak" ] && [ "$peak" -le "$MAX_IN_FLIGHT" ]; then
+    echo "PASS: peak in flight $peak bytes <= $MAX_IN_FLIGHT"
+else
+    echo "FAIL: peak in flight '$peak' bytes"
+    exit 1
+fi
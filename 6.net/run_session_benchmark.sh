@@ -0,0 +1,55 @@
+#!/bin/bash
+
+set -e
+
+# Compares the callback and coroutine asio sessions over loopback: receive
+# rate and heap allocations per message, with and without acks.
+# Usage: ./run_session_benchmark.sh [num_messages] [port]
+
+NUM_MESSAGES=${1:-1000000}
+PORT=${2:-8090}
+# Caps the volume per run so that large payloads do not take forever
+MAX_BYTES=$((2 * 1024 * 1024 * 1024))
+
+make tcp_receiver tcp_sender
+echo ""
+
+run_test() {
+    local session="$1"
+    local payload_size="$2"
+    local ack_flag="$3"
+    local flow_flag="$4"
+    local count=$((NUM_MESSAGES * payload_size < MAX_BYTES ? NUM_MESSAGES : MAX_BYTES / payload_size))
+
+    ./tcp_receiver "$PORT" --session "$session" $ack_flag --quiet > receiver.log &
+    local receiver_pid=$!
+    sleep 0.5
+
+    ./tcp_sender localhost "$PORT" "$count" \
+        --payload-size "$payload_size" $flow_flag | grep "Sent"
+
+    sleep 1  # Let the receiver drain its socket buffers
+    kill -INT "$receiver_pid"
+    wait "$receiver_pid" || true
+    grep -E "Received|Heap allocations" receiver.log
+}
+
+echo "============================================"
+echo "    Session implementation comparison      "
+echo "============================================"
+echo ""
+
+for payload_size in 16 256 4096 65536; do
+    echo "=== Payload: $payload_size bytes ==="
+    for session in callback coro; do
+        echo "$session:"
+        run_test "$session" "$payload_size" "" ""
+        echo "$session with acks:"
+        run_test "$session" "$payload_size" --ack --flow-control
+    done
+    echo "-----------------------------------------------------------"
+    echo ""
+done
+
+rm -f receiver.log
+echo "All session tests completed!"
@@ -0,0 +1,55 @@
+#!/bin/bash
+
+set -e
+
+# Compares loopback TCP with the shared-memory ring transport.
+# Usage: ./run_transport_benchmark.sh [num_messages] [port]
+
+NUM_MESSAGES=${1:-1000000}
+PORT=${2:-8090}
+SHM_NAME=/net_bench_ring
+# Caps the volume per run so that large payloads do not take forever
+MAX_BYTES=$((2 * 1024 * 1024 * 1024))
+
+make tcp_receiver tcp_sender
+echo ""
+
+run_test() {
+    local transport="$1"
+    local payload_size="$2"
+    local count=$((NUM_MESSAGES * payload_size < MAX_BYTES ? NUM_MESSAGES : MAX_BYTES / payload_size))
+    local args=""
+    if [ "$transport" = "shm" ]; then
+        args="--shm $SHM_NAME"
+    fi
+
+    ./tcp_receiver "$PORT" $args --quiet > receiver.log &
+    local receiver_pid=$!
+    sleep 0.5
+
+    ./tcp_sender localhost "$PORT" "$count" $args \
+        --payload-size "$payload_size" | grep "Sent"
+
+    sleep 1  # Let the receiver drain what is still buffered
+    kill -INT "$receiver_pid"
+    wait "$receiver_pid" || true
+    grep "Received" receiver.log
+}
+
+echo "============================================"
+echo "    TCP loopback vs shared-memory ring     "
+echo "============================================"
+echo ""
+
+for payload_size in 16 256 4096 65536; do
+    echo "=== Payload: $payload_size bytes ==="
+    for transport in tcp shm; do
+        echo "$transport:"
+        run_test "$transport" "$payload_size"
+    done
+    echo "-----------------------------------------------------------"
+    echo ""
+done
+
+rm -f receiver.log
+echo "All transport tests completed!"
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+set -e
+
+# Size sweep of plain copying sends vs MSG_ZEROCOPY sends over loopback.
+# Note that on loopback the kernel has to copy zero-copy payloads anyway
+# (reported as "copied by the kernel"); run against a remote receiver to
+# see the NIC path.
+# Usage: ./run_zerocopy_benchmark.sh [host] [port]
+
+HOST=${1:-localhost}
+PORT=${2:-8090}
+# Volume per run
+TOTAL_BYTES=$((2 * 1024 * 1024 * 1024))
+
+make tcp_receiver tcp_sender
+echo ""
+
+start_receiver() {
+    if [ "$HOST" = "localhost" ]; then
+        ./tcp_receiver "$PORT" --quiet > receiver.log &
+        RECEIVER_PID=$!
+        sleep 0.5
+    fi
+}
+
+stop_receiver() {
+    if [ "$HOST" = "localhost" ]; then
+        sleep 1
+        kill -INT "$RECEIVER_PID"
+        wait "$RECEIVER_PID" || true
+    fi
+}
+
+echo "============================================"
+echo "    Copy vs MSG_ZEROCOPY send size sweep   "
+echo "============================================"
+echo ""
+
+for payload_size in 4096 16384 65536 262144 1048576 4194304; do
+    count=$((TOTAL_BYTES / payload_size))
+    echo "=== Payload: $payload_size bytes ($count messages) ==="
+    for mode in copy zerocopy; do
+        # A threshold of 0 disables zero-copy, 1 forces it for every size
+        threshold=0
+        if [ "$mode" = "zerocopy" ]; then
+            threshold=1
+        fi
+        echo "$mode:"
+        start_receiver
+        ./tcp_sender "$HOST" "$PORT" "$count" --payload-size "$payload_size" \
+            --zerocopy-threshold "$threshold" | grep -E "(Sent|Throughput|Zero-copy)"
+        stop_receiver
+    done
+    echo "-----------------------------------------------------------"
+    echo ""
+done
+
+rm -f receiver.log
+echo "Pick --zerocopy-threshold at the smallest size where zerocopy wins."
@@ -0,0 +1,282 @@
+// Copyright 2024
+// Byte ring in POSIX shared memory for same-host message transport
+
+#include "shm_ring.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <utility>
+
+namespace net {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x474e4952'4d48534eULL;  // "NSHMRING"
+constexpr size_t kDataOffset = 4096;
+// Polls before falling back to a futex sleep
+constexpr int kSpinCount = 200;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free");
+
+[[noreturn]] void ThrowErrno(int err, const std::string& what) {
+  throw std::system_error(err, std::generic_category(), what);
+}
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Shared (not FUTEX_PRIVATE) futex operations: the words live in memory
+// mapped by several processes.
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               std::chrono::milliseconds timeout) {
+  timespec ts;
+  ts.tv_sec = timeout.count() / 1000;
+  ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          &ts, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count,
+          nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+// Lives at the start of the segment. Producer- and consumer-owned fields are
+// on separate cache lines.
+struct ShmRing::Header {
+  uint64_t magic;
+  uint64_t capacity;
+
+  // Serializes producers: 0 free, 1 locked, 2 locked with sleepers
+  alignas(64) std::atomic<uint32_t> producer_lock;
+
+  alignas(64) std::atomic<uint64_t> tail;
+  // Bumped by the consumer to wake a producer waiting for space
+  std::atomic<uint32_t> space_seq;
+  std::atomic<uint32_t> producer_sleeping;
+
+  alignas(64) std::atomic<uint64_t> head;
+  // Bumped by producers to wake the consumer waiting for data
+  std::atomic<uint32_t> data_seq;
+  std::atomic<uint32_t> consumer_sleeping;
+};
+
+ShmRing ShmRing::Create(const std::string& name, size_t capacity,
+                        bool replace) {
+  static_assert(sizeof(Header) <= kDataOffset, "header too large");
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    ThrowErrno(EINVAL, "ring capacity must be a power of two");
+  }
+  if (replace) {
+    shm_unlink(name.c_str());
+  }
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    ThrowErrno(errno, "shm_open " + name);
+  }
+  if (ftruncate(fd, static_cast<off_t>(kDataOffset + capacity)) != 0) {
+    int err = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    ThrowErrno(err, "ftruncate " + name);
+  }
+  void* mem = mmap(nullptr, kDataOffset + capacity, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    ThrowErrno(err, "mmap " + name);
+  }
+
+  auto* header = new (mem) Header();
+  header->capacity = capacity;
+  header->magic = kMagic;
+  return ShmRing(name, true, fd, header, capacity);
+}
+
+ShmRing ShmRing::Open(const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    ThrowErrno(errno, "shm_open " + name);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= static_cast<off_t>(kDataOffset)) {
+    close(fd);
+    ThrowErrno(EINVAL, name + " is not a message ring");
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* mem =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    ThrowErrno(err, "mmap " + name);
+  }
+
+  auto* header = static_cast<Header*>(mem);
+  if (header->magic != kMagic || header->capacity != size - kDataOffset) {
+    munmap(mem, size);
+    close(fd);
+    ThrowErrno(EINVAL, name + " is not a message ring");
+  }
+  return ShmRing(name, false, fd, header, header->capacity);
+}
+
+ShmRing::ShmRing(const std::string& name, bool owner, int fd, Header* header,
+                 size_t capacity)
+    : name_(name),
+      owner_(owner),
+      fd_(fd),
+      header_(header),
+      data_(reinterpret_cast<uint8_t*>(header) + kDataOffset),
+      capacity_(capacity) {}
+
+ShmRing::ShmRing(ShmRing&& other) noexcept
+    : name_(std::move(other.name_)),
+      owner_(other.owner_),
+      fd_(other.fd_),
+      header_(other.header_),
+      data_(other.data_),
+      capacity_(other.capacity_) {
+  other.owner_ = false;
+  other.fd_ = -1;
+  other.header_ = nullptr;
+}
+
+ShmRing::~ShmRing() {
+  if (!header_) {
+    return;
+  }
+  munmap(header_, kDataOffset + capacity_);
+  close(fd_);
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+void ShmRing::Write(const iovec* iov, int iovcnt) {
+  LockProducers();
+
+  const uint64_t mask = capacity_ - 1;
+  uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+  auto publish = [this, &tail] {
+    header_->tail.store(tail, std::memory_order_seq_cst);
+    if (header_->consumer_sleeping.load(std::memory_order_seq_cst)) {
+      header_->data_seq.fetch_add(1, std::memory_order_seq_cst);
+      FutexWake(&header_->data_seq, 1);
+    }
+  };
+
+  for (int i = 0; i < iovcnt; ++i) {
+    auto* src = static_cast<const uint8_t*>(iov[i].iov_base);
+    size_t remaining = iov[i].iov_len;
+    while (remaining > 0) {
+      uint64_t head = header_->head.load(std::memory_order_acquire);
+      size_t free = capacity_ - (tail - head);
+      if (free == 0) {
+        // Let the consumer drain what we have so far, then wait for space.
+        publish();
+        for (int spin = 0; spin < kSpinCount && free == 0; ++spin) {
+          CpuRelax();
+          free = capacity_ -
+                 (tail - header_->head.load(std::memory_order_acquire));
+        }
+        if (free == 0) {
+          uint32_t seq = header_->space_seq.load(std::memory_order_seq_cst);
+          header_->producer_sleeping.store(1, std::memory_order_seq_cst);
+          if (header_->head.load(std::memory_order_seq_cst) == head) {
+            FutexWait(&header_->space_seq, seq, std::chrono::milliseconds(10));
+          }
+          header_->producer_sleeping.store(0, std::memory_order_relaxed);
+        }
+        continue;
+      }
+
+      size_t offset = tail & mask;
+      size_t n = std::min({remaining, free, capacity_ - offset});
+      std::memcpy(data_ + offset, src, n);
+      src += n;
+      remaining -= n;
+      tail += n;
+    }
+  }
+  publish();
+
+  UnlockProducers();
+}
+
+size_t ShmRing::Peek(const uint8_t** data, std::chrono::milliseconds timeout) {
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  uint64_t tail = header_->tail.load(std::memory_order_acquire);
+  for (int spin = 0; spin < kSpinCount && tail == head; ++spin) {
+    CpuRelax();
+    tail = header_->tail.load(std::memory_order_acquire);
+  }
+  if (tail == head) {
+    uint32_t seq = header_->data_seq.load(std::memory_order_seq_cst);
+    header_->consumer_sleeping.store(1, std::memory_order_seq_cst);
+    if (header_->tail.load(std::memory_order_seq_cst) == head) {
+      FutexWait(&header_->data_seq, seq, timeout);
+    }
+    header_->consumer_sleeping.store(0, std::memory_order_relaxed);
+    tail = header_->tail.load(std::memory_order_acquire);
+    if (tail == head) {
+      return 0;
+    }
+  }
+
+  size_t offset = head & (capacity_ - 1);
+  *data = data_ + offset;
+  return std::min<size_t>(tail - head, capacity_ - offset);
+}
+
+void ShmRing::Consume(size_t size) {
+  uint64_t head = header_->head.load(std::memory_order_relaxed) + size;
+  header_->head.store(head, std::memory_order_seq_cst);
+  if (header_->producer_sleeping.load(std::memory_order_seq_cst)) {
+    header_->space_seq.fetch_add(1, std::memory_order_seq_cst);
+    FutexWake(&header_->space_seq, 1);
+  }
+}
+
+void ShmRing::LockProducers() {
+  std::atomic<uint32_t>& lock = header_->producer_lock;
+  uint32_t c = 0;
+  if (lock.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+    return;
+  }
+  if (c != 2) {
+    c = lock.exchange(2, std::memory_order_acquire);
+  }
+  while (c != 0) {
+    FutexWait(&lock, 2, std::chrono::milliseconds(100));
+    c = lock.exchange(2, std::memory_order_acquire);
+  }
+}
+
+void ShmRing::UnlockProducers() {
+  if (header_->producer_lock.exchange(0, std::memory_order_release) == 2) {
+    FutexWake(&header_->producer_lock, 1);
+  }
+}
+
+}  // namespace net
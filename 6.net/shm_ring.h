@@ -0,0 +1,79 @@
+// Copyright 2024
+// Byte ring in POSIX shared memory for same-host message transport
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace net {
+
+// A byte stream between processes on one host, carried in a ring buffer in
+// a shm_open() segment. The consumer (receiver) creates the segment; any
+// number of producers (senders) may attach to it. Each Write() is atomic
+// with respect to other producers, so writing whole messages keeps the
+// MessageHeader framing intact (MPSC); a single producer never contends.
+//
+// Both sides spin briefly and then sleep on a futex in the segment. Wakeup
+// syscalls are only made when the other side is actually sleeping, so a busy
+// stream moves data without entering the kernel at all.
+//
+// Throws std::system_error on setup errors.
+class ShmRing {
+ public:
+  // Creates (and on destruction unlinks) the segment `name`, e.g. "/ring".
+  // `capacity` must be a power of two. Fails with EEXIST if the segment
+  // exists, as it may belong to a running receiver; `replace` unlinks it
+  // first, e.g. when it is known to be left over from a crashed one.
+  static ShmRing Create(const std::string& name, size_t capacity,
+                        bool replace = false);
+
+  // Attaches to an existing segment as a producer.
+  static ShmRing Open(const std::string& name);
+
+  ShmRing(ShmRing&& other) noexcept;
+  ~ShmRing();
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+  ShmRing& operator=(ShmRing&&) = delete;
+
+  // Producer: appends the buffers as one unit, blocking while the ring is
+  // full. Units larger than the ring are streamed through it.
+  void Write(const iovec* iov, int iovcnt);
+
+  // Consumer: waits up to `timeout` for data and returns the contiguous
+  // readable bytes (possibly fewer than are available if the data wraps).
+  // Returns 0 on timeout.
+  size_t Peek(const uint8_t** data, std::chrono::milliseconds timeout);
+
+  // Consumer: releases `size` bytes returned by Peek().
+  void Consume(size_t size);
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Header;
+
+  ShmRing(const std::string& name, bool owner, int fd, Header* header,
+          size_t capacity);
+
+  void LockProducers();
+  void UnlockProducers();
+
+  std::string name_;
+  bool owner_;
+  int fd_;
+  Header* header_;
+  uint8_t* data_;
+  size_t capacity_;
+};
+
+}  // namespace net
+
+#endif  // SHM_RING_H_
@@ -0,0 +1,78 @@
+// Copyright 2024
+// Bounded lock-free single-producer single-consumer queue
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace net {
+
+// Ring of `capacity` (a power of two) slots. Each index is written by one
+// side only and sits on its own cache line; each side also caches the
+// other's index, so the shared line is only re-read when the ring looks
+// full (or empty).
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots_(std::make_unique<T[]>(capacity)), mask_(capacity - 1) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer. Returns false (leaving `value` untouched) if the ring is full.
+  bool TryPush(T& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer.
+  std::optional<T> TryPop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return std::nullopt;
+      }
+    }
+    std::optional<T> value(std::move(slots_[head & mask_]));
+    head_.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  // Approximate when called concurrently with the other side (but never
+  // negative: head_ is read first and only ever trails tail_).
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_seq_cst);
+    return tail_.load(std::memory_order_seq_cst) - head;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  std::unique_ptr<T[]> slots_;
+  size_t mask_;
+
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;  // Producer's view of head_
+
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;  // Consumer's view of tail_
+};
+
+}  // namespace net
+
+#endif  // SPSC_QUEUE_H_
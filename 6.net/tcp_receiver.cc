@@ -1,24 +1,164 @@
 // Copyright 2024
-// TCP message receiver using boost::asio
+// TCP message receiver using boost::asio (or io_uring with --backend uring,
+// or a shared-memory ring with --shm)
+
+#include <signal.h>
+
+// Boost 1.74's awaitable.hpp uses std::exchange without including <utility>
+#include <utility>
 
 #include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <chrono>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "alloc_counter.h"
+#include "block_writer.h"
+#include "dispatcher.h"
+#include "frame_codec.h"
 #include "message.h"
+#include "message_parser.h"
+#include "shm_ring.h"
+#include "uring_server.h"
 
 namespace net {
 
 using boost::asio::ip::tcp;
 
+// Final stage for received messages, shared by all backends: stores the
+// payload in the block writer if there is one, otherwise prints it (unless
+// quiet). Always counts.
+//
+// Not thread-safe; with worker threads each one gets its own sink and the
+// sinks share `output_mutex` to serialize the writer and printing.
+class MessageSink {
+ public:
+  // `process_delay` simulates an expensive handler (a slow receiver).
+  MessageSink(BlockWriter* writer, bool quiet,
+              std::chrono::microseconds process_delay,
+              std::mutex* output_mutex = nullptr)
+      : writer_(writer),
+        quiet_(quiet),
+        process_delay_(process_delay),
+        output_mutex_(output_mutex) {}
+
+  void Handle(const MessageHeader& header, const uint8_t* data) {
+    last_ = std::chrono::steady_clock::now();
+    last_allocations_ = HeapAllocations();
+    if (messages_ == 0) {
+      first_ = last_;
+      first_allocations_ = last_allocations_;
+    }
+    ++messages_;
+    bytes_ += header.length;
+
+    if (writer_ || !quiet_) {
+      std::unique_lock<std::mutex> lock;
+      if (output_mutex_) {
+        lock = std::unique_lock<std::mutex>(*output_mutex_);
+      }
+      if (writer_) {
+        writer_->Write(header.position, data, header.length);
+      } else {
+        PrintMessage(header, data);
+      }
+    }
+    if (process_delay_.count() > 0) {
+      std::this_thread::sleep_for(process_delay_);
+    }
+  }
+
+  // Folds in the counters of another sink (e.g. of another worker).
+  void Merge(const MessageSink& other) {
+    if (other.messages_ == 0) {
+      return;
+    }
+    if (messages_ == 0) {
+      first_ = other.first_;
+      last_ = other.last_;
+      first_allocations_ = other.first_allocations_;
+      last_allocations_ = other.last_allocations_;
+    } else {
+      first_ = std::min(first_, other.first_);
+      last_ = std::max(last_, other.last_);
+      first_allocations_ =
+          std::min(first_allocations_, other.first_allocations_);
+      last_allocations_ = std::max(last_allocations_, other.last_allocations_);
+    }
+    messages_ += other.messages_;
+    bytes_ += other.bytes_;
+  }
+
+  void PrintStats() const {
+    std::chrono::duration<double> elapsed = last_ - first_;
+    std::cout << "Received " << messages_ << " messages (" << bytes_
+              << " bytes)";
+    if (messages_ > 0 && elapsed.count() > 0) {
+      std::cout << ", " << std::fixed << std::setprecision(0)
+                << messages_ / elapsed.count() << " msg/s";
+    }
+    std::cout << std::endl;
+    if (messages_ > 1) {
+      uint64_t allocations = last_allocations_ - first_allocations_;
+      std::cout << "Heap allocations while receiving: " << allocations << " ("
+                << std::setprecision(2)
+                << static_cast<double>(allocations) / (messages_ - 1)
+                << " per message)" << std::endl;
+    }
+  }
+
+ private:
+  static void PrintMessage(const MessageHeader& header, const uint8_t* data) {
+    std::cout << "Position: " << header.position
+              << ", Length: " << header.length
+              << ", Data: ";
+
+    // Print data as hex
+    for (uint32_t i = 0; i < header.length; ++i) {
+      std::cout << std::hex << std::setw(2) << std::setfill('0')
+                << static_cast<int>(data[i]);
+    }
+    std::cout << std::dec << std::endl;
+  }
+
+  BlockWriter* writer_;
+  bool quiet_;
+  std::chrono::microseconds process_delay_;
+  std::mutex* output_mutex_;
+  uint64_t messages_ = 0;
+  uint64_t bytes_ = 0;
+  std::chrono::steady_clock::time_point first_;
+  std::chrono::steady_clock::time_point last_;
+  uint64_t first_allocations_ = 0;
+  uint64_t last_allocations_ = 0;
+};
+
+// With acks enabled, processed bytes are acknowledged once this many have
+// accumulated, or earlier when the socket has nothing more buffered.
+constexpr size_t kAckBytes = 64 << 10;
+
 class Session : public std::enable_shared_from_this<Session> {
  public:
-  explicit Session(tcp::socket socket) : socket_(std::move(socket)) {}
+  Session(tcp::socket socket, MessageSink* sink, bool send_acks)
+      : socket_(std::move(socket)), sink_(sink), send_acks_(send_acks) {}
 
-  void Start() { ReadHeader(); }
+  void Start() {
+    if (send_acks_) {
+      socket_.set_option(tcp::no_delay(true));  // Acks are tiny and urgent
+    }
+    ReadHeader();
+  }
 
  private:
   void ReadHeader() {
@@ -43,7 +183,10 @@ class Session : public std::enable_shared_from_this<Session> {
         boost::asio::buffer(message_.data.data(), message_.header.length),
         [this, self](boost::system::error_code ec, std::size_t /*length*/) {
           if (!ec) {
-            PrintMessage();
+            sink_->Handle(message_.header, message_.data.data());
+            if (send_acks_) {
+              MaybeAck();
+            }
             ReadHeader();  // Continue reading next message
           } else if (ec != boost::asio::error::eof) {
             std::cerr << "Error reading data: " << ec.message() << std::endl;
@@ -51,29 +194,317 @@ class Session : public std::enable_shared_from_this<Session> {
         });
   }
 
-  void PrintMessage() {
-    std::cout << "Position: " << message_.header.position
-              << ", Length: " << message_.header.length
-              << ", Data: ";
-
-    // Print data as hex
-    for (const auto& byte : message_.data) {
-      std::cout << std::hex << std::setw(2) << std::setfill('0')
-                << static_cast<int>(byte);
+  // Cumulative acknowledgement of the last processed position. At most one
+  // ack write is in flight; acks due meanwhile are merged into the next one.
+  void MaybeAck() {
+    unacked_bytes_ += sizeof(MessageHeader) + message_.header.length;
+    processed_position_ = message_.header.position;
+    if (unacked_bytes_ < kAckBytes && socket_.available() > 0) {
+      return;
     }
-    std::cout << std::dec << std::endl;
+    if (ack_in_flight_) {
+      ack_wanted_ = true;
+      return;
+    }
+    WriteAck();
+  }
+
+  void WriteAck() {
+    ack_.position = processed_position_;
+    unacked_bytes_ = 0;
+    ack_in_flight_ = true;
+    ack_wanted_ = false;
+    auto self = shared_from_this();
+    boost::asio::async_write(
+        socket_, boost::asio::buffer(&ack_, sizeof(AckMessage)),
+        [this, self](boost::system::error_code ec, std::size_t /*length*/) {
+          ack_in_flight_ = false;
+          if (!ec && ack_wanted_) {
+            WriteAck();
+          }
+        });
   }
 
   tcp::socket socket_;
+  MessageSink* sink_;
   Message message_;
+
+  bool send_acks_;
+  AckMessage ack_;
+  uint64_t processed_position_ = 0;
+  size_t unacked_bytes_ = 0;
+  bool ack_in_flight_ = false;
+  bool ack_wanted_ = false;
+};
+
+// Frames larger than this are treated as corrupt
+constexpr uint32_t kMaxFrameBytes = 256 << 20;
+
+// Session for a stream of FrameHeader-prefixed compressed frames (tcp_sender
+// --compress). Each frame is inflated and its records run through a
+// MessageParser, since messages may span frames.
+class CompressedSession
+    : public std::enable_shared_from_this<CompressedSession> {
+ public:
+  CompressedSession(tcp::socket socket, MessageSink* sink,
+                    CodecStats* codec_stats)
+      : socket_(std::move(socket)), sink_(sink), decompressor_(codec_stats) {}
+
+  void Start() { ReadFrameHeader(); }
+
+ private:
+  void ReadFrameHeader() {
+    auto self = shared_from_this();
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(&header_, sizeof(FrameHeader)),
+        [this, self](boost::system::error_code ec, std::size_t /*length*/) {
+          if (!ec) {
+            ReadFrame();
+          } else if (ec != boost::asio::error::eof) {
+            std::cerr << "Error reading frame header: " << ec.message()
+                      << std::endl;
+          }
+        });
+  }
+
+  void ReadFrame() {
+    if (header_.compressed_length > kMaxFrameBytes ||
+        header_.raw_length > kMaxFrameBytes) {
+      std::cerr << "Invalid frame header, closing connection" << std::endl;
+      return;
+    }
+    body_.resize(header_.compressed_length);
+    auto self = shared_from_this();
+    boost::asio::async_read(
+        socket_, boost::asio::buffer(body_),
+        [this, self](boost::system::error_code ec, std::size_t /*length*/) {
+          if (ec) {
+            std::cerr << "Error reading frame: " << ec.message() << std::endl;
+            return;
+          }
+          try {
+            decompressor_.Decompress(header_, body_.data(), &raw_);
+          } catch (const std::exception& e) {
+            std::cerr << e.what() << ", closing connection" << std::endl;
+            return;
+          }
+          parser_.Feed(raw_.data(), raw_.size(),
+                       [this](const MessageHeader& header,
+                              const uint8_t* data) {
+                         sink_->Handle(header, data);
+                       });
+          ReadFrameHeader();
+        });
+  }
+
+  tcp::socket socket_;
+  MessageSink* sink_;
+  FrameDecompressor decompressor_;
+  MessageParser parser_;
+  FrameHeader header_;
+  std::vector<uint8_t> body_;
+  std::vector<uint8_t> raw_;
+};
+
+// Coroutine counterpart of Session: the same protocol as straight-line code.
+// The frame lives for the whole connection, so there is no shared_ptr
+// juggling per step; the per-operation frames that use_awaitable creates are
+// recycled by Asio's per-thread frame cache instead of hitting the heap.
+// An ack is written inline (8 bytes; it practically never blocks).
+boost::asio::awaitable<void> RunCoroSession(tcp::socket socket,
+                                            MessageSink* sink,
+                                            bool send_acks) {
+  using boost::asio::redirect_error;
+  using boost::asio::use_awaitable;
+
+  if (send_acks) {
+    socket.set_option(tcp::no_delay(true));
+  }
+  Message message;
+  AckMessage ack;
+  size_t unacked_bytes = 0;
+  boost::system::error_code ec;
+  for (;;) {
+    co_await boost::asio::async_read(
+        socket, boost::asio::buffer(&message.header, sizeof(MessageHeader)),
+        redirect_error(use_awaitable, ec));
+    if (ec) {
+      if (ec != boost::asio::error::eof) {
+        std::cerr << "Error reading header: " << ec.message() << std::endl;
+      }
+      co_return;
+    }
+
+    message.data.resize(message.header.length);
+    co_await boost::asio::async_read(
+        socket, boost::asio::buffer(message.data.data(), message.header.length),
+        redirect_error(use_awaitable, ec));
+    if (ec) {
+      if (ec != boost::asio::error::eof) {
+        std::cerr << "Error reading data: " << ec.message() << std::endl;
+      }
+      co_return;
+    }
+    sink->Handle(message.header, message.data.data());
+
+    if (send_acks) {
+      unacked_bytes += sizeof(MessageHeader) + message.header.length;
+      if (unacked_bytes >= kAckBytes || socket.available() == 0) {
+        ack.position = message.header.position;
+        unacked_bytes = 0;
+        co_await boost::asio::async_write(
+            socket, boost::asio::buffer(&ack, sizeof(AckMessage)),
+            redirect_error(use_awaitable, ec));
+        if (ec) {
+          co_return;
+        }
+      }
+    }
+  }
+}
+
+// Bytes read per batch by a DispatchSession
+constexpr size_t kDispatchBatchBytes = 64 << 10;
+// How long a DispatchSession waits before retrying a full worker queue
+constexpr auto kDispatchRetryDelay = std::chrono::microseconds(50);
+
+// Session feeding a Dispatcher: reads whatever the socket has into a batch
+// buffer and hands the complete messages in it to the connection's worker;
+// a trailing partial message is carried over into the next buffer. While
+// the worker's queue is full the session stops reading, so the socket
+// buffer fills up and TCP pushes back on the sender.
+class DispatchSession
+    : public std::enable_shared_from_this<DispatchSession> {
+ public:
+  DispatchSession(tcp::socket socket, Dispatcher* dispatcher, size_t worker)
+      : socket_(std::move(socket)),
+        retry_timer_(socket_.get_executor()),
+        dispatcher_(dispatcher),
+        worker_(worker),
+        buffer_(dispatcher->AcquireBuffer(worker)) {}
+
+  // When io_context.stop() abandons the session, complete messages may
+  // still be waiting for queue space; hand them over before the dispatcher
+  // is stopped instead of dropping them.
+  ~DispatchSession() {
+    while (pending_.size > 0 && !dispatcher_->TryDispatch(worker_, pending_)) {
+      std::this_thread::sleep_for(kDispatchRetryDelay);
+    }
+  }
+
+  void Start() { Read(); }
+
+ private:
+  void Read() {
+    buffer_.Reserve(std::max(kDispatchBatchBytes, record_size_));
+    auto self = shared_from_this();
+    socket_.async_read_some(
+        boost::asio::buffer(buffer_.data.get() + buffer_.size,
+                            buffer_.capacity - buffer_.size),
+        [this, self](boost::system::error_code ec, std::size_t length) {
+          if (!ec) {
+            OnRead(length);
+          } else if (ec != boost::asio::error::eof) {
+            std::cerr << "Error reading: " << ec.message() << std::endl;
+          }
+        });
+  }
+
+  void OnRead(size_t length) {
+    buffer_.size += length;
+    const uint8_t* data = buffer_.data.get();
+    size_t complete = 0;
+    record_size_ = sizeof(MessageHeader);
+    while (buffer_.size - complete >= sizeof(MessageHeader)) {
+      MessageHeader header;
+      std::memcpy(&header, data + complete, sizeof(header));
+      size_t total = sizeof(MessageHeader) + header.length;
+      if (buffer_.size - complete < total) {
+        record_size_ = total;
+        break;
+      }
+      complete += total;
+    }
+    if (complete == 0) {
+      Read();
+      return;
+    }
+
+    Batch next = dispatcher_->AcquireBuffer(worker_);
+    size_t tail = buffer_.size - complete;
+    next.Reserve(std::max({kDispatchBatchBytes, record_size_, tail}));
+    std::memcpy(next.data.get(), data + complete, tail);
+    next.size = tail;
+    buffer_.size = complete;
+    pending_ = std::move(buffer_);
+    buffer_ = std::move(next);
+    Dispatch();
+  }
+
+  void Dispatch() {
+    if (dispatcher_->TryDispatch(worker_, pending_)) {
+      if (stalled_) {
+        dispatcher_->RecordStall(
+            worker_, std::chrono::steady_clock::now() - stall_start_);
+        stalled_ = false;
+      }
+      Read();
+      return;
+    }
+    if (!stalled_) {
+      stall_start_ = std::chrono::steady_clock::now();
+      stalled_ = true;
+    }
+    auto self = shared_from_this();
+    retry_timer_.expires_after(kDispatchRetryDelay);
+    retry_timer_.async_wait([this, self](boost::system::error_code ec) {
+      if (!ec) {
+        Dispatch();
+      }
+    });
+  }
+
+  tcp::socket socket_;
+  boost::asio::steady_timer retry_timer_;
+  Dispatcher* dispatcher_;
+  size_t worker_;
+  Batch buffer_;   // Being filled by reads
+  Batch pending_;  // Complete messages waiting for queue space
+  // Bytes needed to complete the first record in buffer_
+  size_t record_size_ = sizeof(MessageHeader);
+  bool stalled_ = false;
+  std::chrono::steady_clock::time_point stall_start_;
+};
+
+// How the asio server handles its connections. At most one of codec_stats
+// and dispatcher is set.
+struct SessionOptions {
+  bool send_acks = false;
+  bool coroutines = false;
+  // Set for compressed streams; collects the decompression stats
+  CodecStats* codec_stats = nullptr;
+  // Set to handle messages on worker threads
+  Dispatcher* dispatcher = nullptr;
+  // Shared with the workers' sinks when the dispatcher is used; guards the
+  // block writer
+  std::mutex* output_mutex = nullptr;
 };
 
 class Server {
  public:
-  Server(boost::asio::io_context& io_context, uint16_t port)
-      : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)) {
+  Server(boost::asio::io_context& io_context, uint16_t port,
+         MessageSink* sink, BlockWriter* writer,
+         const SessionOptions& options)
+      : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
+        poll_timer_(io_context),
+        sink_(sink),
+        writer_(writer),
+        options_(options) {
     std::cout << "Server listening on port " << port << std::endl;
     Accept();
+    if (writer_) {
+      SchedulePoll();
+    }
   }
 
  private:
@@ -84,7 +515,7 @@ class Server {
             std::cout << "New connection from "
                       << socket.remote_endpoint().address().to_string()
                       << std::endl;
-            std::make_shared<Session>(std::move(socket))->Start();
+            StartSession(std::move(socket));
           } else {
             std::cerr << "Accept error: " << ec.message() << std::endl;
           }
@@ -92,21 +523,347 @@ class Server {
         });
   }
 
+  void StartSession(tcp::socket socket) {
+    if (options_.dispatcher) {
+      // Round robin; the connection then sticks to its worker.
+      size_t worker = next_connection_++ % options_.dispatcher->workers();
+      std::make_shared<DispatchSession>(std::move(socket),
+                                        options_.dispatcher, worker)
+          ->Start();
+    } else if (options_.codec_stats) {
+      std::make_shared<CompressedSession>(std::move(socket), sink_,
+                                          options_.codec_stats)
+          ->Start();
+    } else if (options_.coroutines) {
+      boost::asio::co_spawn(
+          acceptor_.get_executor(),
+          RunCoroSession(std::move(socket), sink_, options_.send_acks),
+          boost::asio::detached);
+    } else {
+      std::make_shared<Session>(std::move(socket), sink_, options_.send_acks)
+          ->Start();
+    }
+  }
+
+  // Drives the time-based flush and sync thresholds of the block writer.
+  void SchedulePoll() {
+    poll_timer_.expires_after(std::chrono::milliseconds(10));
+    poll_timer_.async_wait([this](boost::system::error_code ec) {
+      if (!ec) {
+        std::unique_lock<std::mutex> lock;
+        if (options_.output_mutex) {
+          lock = std::unique_lock<std::mutex>(*options_.output_mutex);
+        }
+        writer_->Poll();
+        SchedulePoll();
+      }
+    });
+  }
+
   tcp::acceptor acceptor_;
+  boost::asio::steady_timer poll_timer_;
+  MessageSink* sink_;
+  BlockWriter* writer_;
+  SessionOptions options_;
+  uint64_t next_connection_ = 0;
 };
 
+// Consumes the MessageHeader-framed stream that senders write into `ring`
+// until `stopped` is set.
+void RunShmReceiver(ShmRing& ring, MessageSink* sink, BlockWriter* writer,
+                    const volatile sig_atomic_t& stopped) {
+  MessageParser parser;
+  auto handle = [sink](const MessageHeader& header, const uint8_t* data) {
+    sink->Handle(header, data);
+  };
+  while (!stopped) {
+    const uint8_t* data;
+    size_t size = ring.Peek(&data, std::chrono::milliseconds(10));
+    if (size > 0) {
+      parser.Feed(data, size, handle);
+      ring.Consume(size);
+    }
+    if (writer) {
+      writer->Poll();
+    }
+  }
+}
+
 }  // namespace net
 
+volatile sig_atomic_t g_stopped = 0;
+net::UringServer* g_uring_server = nullptr;
+
+void HandleStopSignal(int /*signal*/) {
+  g_stopped = 1;
+  if (g_uring_server) {
+    g_uring_server->Stop();
+  }
+}
+
+// No SA_RESTART: blocking waits in the io_uring and shm loops must return.
+void InstallStopHandler() {
+  struct sigaction action = {};
+  action.sa_handler = HandleStopSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+}
+
+constexpr size_t kDefaultShmSize = 4 << 20;
+
+void PrintUsage(const char* prog_name) {
+  std::cout << "Usage: " << prog_name << " [port] [--backend asio|uring] "
+            << "[--session callback|coro] "
+            << "[--compressed] [--workers N] [--worker-queue N] "
+            << "[--shm NAME] [--shm-size N] [--shm-replace] [--ack] "
+            << "[--process-delay-us N] "
+            << "[--quiet] [--output PATH] "
+            << "[--flush-bytes N] [--flush-ms N] [--sync-bytes N] "
+            << "[--sync-ms N]" << std::endl;
+  std::cout << "  --backend B      : asio (epoll reactor, default) or uring "
+            << "(io_uring multishot recv)" << std::endl;
+  std::cout << "  --session S      : asio connection handling: callback "
+            << "(default) or coro (C++20 coroutine)" << std::endl;
+  std::cout << "  --compressed     : Expect deflate frames from senders "
+            << "using --compress (asio backend)" << std::endl;
+  std::cout << "  --workers N      : Handle messages on N worker threads, "
+            << "connections spread over them (asio backend)" << std::endl;
+  std::cout << "  --worker-queue N : Batches queued per worker before reads "
+            << "pause, power of two (default: "
+            << net::DispatcherOptions().queue_depth << ")" << std::endl;
+  std::cout << "  --shm NAME       : Receive from shared-memory ring NAME "
+            << "(e.g. /net_ring) instead of TCP" << std::endl;
+  std::cout << "  --shm-size N     : Ring capacity in bytes, power of two "
+            << "(default: " << kDefaultShmSize << ")" << std::endl;
+  std::cout << "  --shm-replace    : Remove an existing ring NAME first, e.g. "
+            << "one left over from a crashed receiver" << std::endl;
+  std::cout << "  --ack            : Acknowledge processed positions for "
+            << "senders using --flow-control (asio backend)" << std::endl;
+  std::cout << "  --process-delay-us N : Sleep N us per message (simulates "
+            << "a slow receiver)" << std::endl;
+  std::cout << "  --quiet          : Only count messages, do not print them"
+            << std::endl;
+  std::cout << "  --output PATH    : Write each payload to PATH at its "
+            << "position instead of printing it" << std::endl;
+  std::cout << "  --flush-bytes N  : Buffered bytes that trigger a flush"
+            << std::endl;
+  std::cout << "  --flush-ms N     : Max age of buffered data in ms"
+            << std::endl;
+  std::cout << "  --sync-bytes N   : Written bytes that trigger fdatasync"
+            << std::endl;
+  std::cout << "  --sync-ms N      : Max time between syncs in ms" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
   try {
     uint16_t port = 8080;
-    if (argc > 1) {
-      port = static_cast<uint16_t>(std::stoi(argv[1]));
+    std::string backend = "asio";
+    std::string session = "callback";
+    std::string shm_name;
+    size_t shm_size = kDefaultShmSize;
+    bool shm_replace = false;
+    bool send_acks = false;
+    bool compressed = false;
+    net::DispatcherOptions dispatcher_options;
+    dispatcher_options.workers = 0;
+    int64_t process_delay_us = 0;
+    bool quiet = false;
+    std::string output_path;
+    net::BlockWriterOptions writer_options;
+
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--backend" && i + 1 < argc) {
+        backend = argv[++i];
+      } else if (arg == "--session" && i + 1 < argc) {
+        session = argv[++i];
+      } else if (arg == "--shm" && i + 1 < argc) {
+        shm_name = argv[++i];
+      } else if (arg == "--shm-size" && i + 1 < argc) {
+        shm_size = std::stoull(argv[++i]);
+      } else if (arg == "--shm-replace") {
+        shm_replace = true;
+      } else if (arg == "--ack") {
+        send_acks = true;
+      } else if (arg == "--compressed") {
+        compressed = true;
+      } else if (arg == "--workers" && i + 1 < argc) {
+        dispatcher_options.workers = std::stoull(argv[++i]);
+      } else if (arg == "--worker-queue" && i + 1 < argc) {
+        dispatcher_options.queue_depth = std::stoull(argv[++i]);
+      } else if (arg == "--process-delay-us" && i + 1 < argc) {
+        process_delay_us = std::stoll(argv[++i]);
+      } else if (arg == "--quiet") {
+        quiet = true;
+      } else if (arg == "--output" && i + 1 < argc) {
+        output_path = argv[++i];
+      } else if (arg == "--flush-bytes" && i + 1 < argc) {
+        writer_options.flush_bytes = std::stoull(argv[++i]);
+      } else if (arg == "--flush-ms" && i + 1 < argc) {
+        writer_options.flush_interval =
+            std::chrono::milliseconds(std::stoll(argv[++i]));
+      } else if (arg == "--sync-bytes" && i + 1 < argc) {
+        writer_options.sync_bytes = std::stoull(argv[++i]);
+      } else if (arg == "--sync-ms" && i + 1 < argc) {
+        writer_options.sync_interval =
+            std::chrono::milliseconds(std::stoll(argv[++i]));
+      } else if (arg == "--help" || arg == "-h") {
+        PrintUsage(argv[0]);
+        return 0;
+      } else if (arg[0] != '-') {
+        port = static_cast<uint16_t>(std::stoi(arg));
+      } else {
+        std::cerr << "Unknown argument: " << arg << std::endl;
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+    if (backend != "asio" && backend != "uring") {
+      std::cerr << "Unknown backend: " << backend << std::endl;
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    if (session != "callback" && session != "coro") {
+      std::cerr << "Unknown session type: " << session << std::endl;
+      PrintUsage(argv[0]);
+      return 1;
     }
+    if (send_acks && (backend != "asio" || !shm_name.empty())) {
+      // The shared-memory ring is flow controlled by its capacity already.
+      std::cerr << "--ack is only supported by the asio TCP backend"
+                << std::endl;
+      return 1;
+    }
+
+    if (compressed &&
+        (backend != "asio" || !shm_name.empty() || send_acks ||
+         session != "callback")) {
+      std::cerr << "--compressed is only supported by the asio TCP backend "
+                << "with callback sessions and without --ack" << std::endl;
+      return 1;
+    }
+
+    size_t queue_depth = dispatcher_options.queue_depth;
+    if (dispatcher_options.workers > 0 &&
+        (backend != "asio" || !shm_name.empty() || send_acks || compressed ||
+         session != "callback" || queue_depth == 0 ||
+         (queue_depth & (queue_depth - 1)) != 0)) {
+      // Acks would have to wait for the workers to report progress.
+      std::cerr << "--workers is only supported by the asio TCP backend "
+                << "with callback sessions, without --ack or --compressed, "
+                << "and with a power-of-two --worker-queue" << std::endl;
+      return 1;
+    }
+
+    std::optional<net::BlockWriter> writer;
+    if (!output_path.empty()) {
+      writer.emplace(output_path, writer_options);
+      std::cout << "Writing payloads to " << output_path << std::endl;
+    }
+    net::BlockWriter* writer_ptr = writer ? &*writer : nullptr;
+    net::MessageSink sink(writer_ptr, quiet,
+                          std::chrono::microseconds(process_delay_us));
+    net::CodecStats codec_stats;
+
+    // With workers, every worker has a sink of its own; they are merged into
+    // `sink` at the end.
+    std::mutex output_mutex;
+    std::vector<std::unique_ptr<net::MessageSink>> worker_sinks;
+    std::optional<net::Dispatcher> dispatcher;
+    if (dispatcher_options.workers > 0) {
+      for (size_t i = 0; i < dispatcher_options.workers; ++i) {
+        worker_sinks.push_back(std::make_unique<net::MessageSink>(
+            writer_ptr, quiet, std::chrono::microseconds(process_delay_us),
+            &output_mutex));
+      }
+      dispatcher.emplace(
+          [&worker_sinks](size_t worker, const net::MessageHeader& header,
+                          const uint8_t* data) {
+            worker_sinks[worker]->Handle(header, data);
+          },
+          dispatcher_options);
+      std::cout << "Handling messages on " << dispatcher_options.workers
+                << " worker threads" << std::endl;
+    }
+
+    if (!shm_name.empty()) {
+      net::ShmRing ring = net::ShmRing::Create(shm_name, shm_size, shm_replace);
+      std::cout << "Receiving from shared-memory ring " << shm_name << " ("
+                << ring.capacity() << " bytes)" << std::endl;
+      InstallStopHandler();
+      net::RunShmReceiver(ring, &sink, writer_ptr, g_stopped);
+    } else if (backend == "uring") {
+      net::UringServer server(
+          port,
+          [&sink](const net::MessageHeader& header, const uint8_t* data) {
+            sink.Handle(header, data);
+          },
+          net::UringServerOptions());
 
-    boost::asio::io_context io_context;
-    net::Server server(io_context, port);
-    io_context.run();
+      g_uring_server = &server;
+      InstallStopHandler();
+
+      std::function<void()> on_tick;
+      if (writer_ptr) {
+        on_tick = [writer_ptr] { writer_ptr->Poll(); };
+      }
+      server.Run(on_tick);
+      g_uring_server = nullptr;
+    } else {
+      boost::asio::io_context io_context;
+      net::SessionOptions session_options;
+      session_options.send_acks = send_acks;
+      session_options.coroutines = session == "coro";
+      if (compressed) {
+        session_options.codec_stats = &codec_stats;
+      }
+      if (dispatcher) {
+        session_options.dispatcher = &*dispatcher;
+        session_options.output_mutex = &output_mutex;
+      }
+      net::Server server(io_context, port, &sink, writer_ptr,
+                         session_options);
+
+      // Stop cleanly so that buffered payloads get flushed and synced.
+      boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+      signals.async_wait(
+          [&io_context](boost::system::error_code, int) { io_context.stop(); });
+
+      io_context.run();
+      // Leaving this scope destroys the abandoned sessions, which flush
+      // their pending batches into the still running dispatcher.
+    }
+
+    if (dispatcher) {
+      dispatcher->Stop();
+      for (const auto& worker_sink : worker_sinks) {
+        sink.Merge(*worker_sink);
+      }
+    }
+    sink.PrintStats();
+    if (dispatcher) {
+      dispatcher->PrintStats(std::cout);
+    }
+    if (compressed) {
+      double cpu_ms = std::chrono::duration<double, std::milli>(
+                          codec_stats.cpu_time).count();
+      std::cout << "Inflated " << codec_stats.wire_bytes << " bytes from "
+                << codec_stats.frames << " frames into "
+                << codec_stats.raw_bytes << " bytes, inflate CPU "
+                << std::fixed << std::setprecision(1) << cpu_ms << " ms"
+                << std::endl;
+    }
+    if (writer) {
+      writer->Sync();
+      const auto& stats = writer->stats();
+      std::cout << "Wrote " << stats.bytes_written << " bytes in "
+                << stats.pwrites << " pwrites";
+      if (stats.pwrites > 0) {
+        std::cout << " (avg " << stats.bytes_written / stats.pwrites
+                  << " bytes)";
+      }
+      std::cout << ", " << stats.syncs << " syncs" << std::endl;
+    }
   } catch (const std::exception& e) {
     std::cerr << "Exception: " << e.what() << std::endl;
     return 1;
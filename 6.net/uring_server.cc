@@ -0,0 +1,408 @@
+// Copyright 2024
+// TCP message receiver backend built directly on io_uring
+
+#include "uring_server.h"
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+namespace net {
+
+namespace {
+
+// Completion tags stored in the upper half of user_data; the lower half
+// holds the file descriptor.
+constexpr uint64_t kAcceptTag = 1;
+constexpr uint64_t kRecvTag = 2;
+constexpr uint16_t kBufferGroup = 0;
+
+uint64_t MakeUserData(uint64_t tag, int fd) {
+  return (tag << 32) | static_cast<uint32_t>(fd);
+}
+
+[[noreturn]] void ThrowErrno(int err, const char* what) {
+  throw std::system_error(err, std::generic_category(), what);
+}
+
+template <typename T>
+T LoadAcquire(const T* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void StoreRelease(T* p, T v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+// Minimal io_uring instance: the mmapped submission and completion queues
+// plus the provided-buffer ring.
+struct UringServer::Ring {
+  Ring(unsigned entries, unsigned num_buffers, size_t buffer_size) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // We are the only thread touching the ring, so completion work can be
+    // deferred to our next io_uring_enter() instead of interrupting us.
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                   IORING_SETUP_SINGLE_ISSUER;
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0 && errno == EINVAL) {
+      std::memset(&params, 0, sizeof(params));
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+    if (fd < 0) {
+      ThrowErrno(errno, "io_uring_setup");
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+      close(fd);
+      ThrowErrno(ENOSYS, "io_uring is too old (need SINGLE_MMAP, EXT_ARG)");
+    }
+
+    rings_len = std::max(
+        params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings = mmap(nullptr, rings_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      ThrowErrno(err, "mmap io_uring rings");
+    }
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+        mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+      int err = errno;
+      munmap(rings, rings_len);
+      close(fd);
+      ThrowErrno(err, "mmap io_uring sqes");
+    }
+
+    auto* base = static_cast<uint8_t*>(rings);
+    sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    local_sq_tail = *sq_tail;
+
+    try {
+      SetUpBuffers(num_buffers, buffer_size);
+    } catch (...) {
+      munmap(sqes, sqes_len);
+      munmap(rings, rings_len);
+      close(fd);
+      throw;
+    }
+  }
+
+  ~Ring() {
+    munmap(buf_ring, buf_ring_len);
+    munmap(sqes, sqes_len);
+    munmap(rings, rings_len);
+    close(fd);
+  }
+
+  // Registers `num_buffers` receive buffers the kernel picks from for
+  // IOSQE_BUFFER_SELECT requests.
+  void SetUpBuffers(unsigned num_buffers, size_t size) {
+    buffer_size = size;
+    buf_mask = num_buffers - 1;
+    buffers.reset(new uint8_t[num_buffers * size]);
+
+    buf_ring_len = num_buffers * sizeof(io_uring_buf);
+    void* mem = mmap(nullptr, buf_ring_len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      ThrowErrno(errno, "mmap buffer ring");
+    }
+    // The buffers overlay the ring header, which only contributes the tail.
+    // Index them directly: in C++ the header's flexible `bufs` member is
+    // shifted by the empty struct in __DECLARE_FLEX_ARRAY.
+    buf_ring = static_cast<io_uring_buf_ring*>(mem);
+    bufs = static_cast<io_uring_buf*>(mem);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = num_buffers;
+    reg.bgid = kBufferGroup;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg,
+                1) < 0) {
+      int err = errno;
+      munmap(buf_ring, buf_ring_len);
+      ThrowErrno(err, "io_uring_register(PBUF_RING)");
+    }
+
+    for (unsigned i = 0; i < num_buffers; ++i) {
+      AddBuffer(static_cast<uint16_t>(i));
+    }
+    PublishBuffers();
+  }
+
+  uint8_t* Buffer(uint16_t bid) { return buffers.get() + bid * buffer_size; }
+
+  // Queues a buffer for reuse; visible to the kernel after PublishBuffers().
+  void AddBuffer(uint16_t bid) {
+    io_uring_buf* buf = &bufs[buf_tail & buf_mask];
+    buf->addr = reinterpret_cast<uint64_t>(Buffer(bid));
+    buf->len = static_cast<uint32_t>(buffer_size);
+    buf->bid = bid;
+    ++buf_tail;
+  }
+
+  void PublishBuffers() { StoreRelease(&buf_ring->tail, buf_tail); }
+
+  // Returns a zeroed SQE, submitting queued entries first if the SQ is full.
+  io_uring_sqe* GetSqe() {
+    while (local_sq_tail - LoadAcquire(sq_head) == sq_entries) {
+      Enter(0, 0);
+    }
+    unsigned index = local_sq_tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++local_sq_tail;
+    ++to_submit;
+    return sqe;
+  }
+
+  // Submits queued SQEs and optionally waits for completions, for at most
+  // `timeout` if one is given. Returns false if interrupted by a signal.
+  bool Enter(unsigned min_complete, unsigned flags,
+             const __kernel_timespec* timeout = nullptr) {
+    StoreRelease(sq_tail, local_sq_tail);
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    const void* argp = nullptr;
+    size_t argsz = 0;
+    if (timeout) {
+      arg.ts = reinterpret_cast<uint64_t>(timeout);
+      argp = &arg;
+      argsz = sizeof(arg);
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                       min_complete, flags, argp, argsz));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        return false;
+      }
+      if (errno == ETIME) {
+        return true;
+      }
+      ThrowErrno(errno, "io_uring_enter");
+    }
+    to_submit -= static_cast<unsigned>(ret);
+    return true;
+  }
+
+  int fd = -1;
+  void* rings = nullptr;
+  size_t rings_len = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_len = 0;
+
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned sq_mask = 0;
+  unsigned sq_entries = 0;
+  unsigned local_sq_tail = 0;
+  unsigned to_submit = 0;
+
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  io_uring_buf_ring* buf_ring = nullptr;
+  io_uring_buf* bufs = nullptr;
+  size_t buf_ring_len = 0;
+  uint16_t buf_tail = 0;
+  unsigned buf_mask = 0;
+  size_t buffer_size = 0;
+  std::unique_ptr<uint8_t[]> buffers;
+};
+
+UringServer::UringServer(uint16_t port, Handler handler,
+                         const UringServerOptions& options)
+    : handler_(std::move(handler)), options_(options) {
+  if (options_.num_buffers == 0 ||
+      (options_.num_buffers & (options_.num_buffers - 1)) != 0 ||
+      options_.num_buffers > 32768) {
+    ThrowErrno(EINVAL, "num_buffers must be a power of two <= 32768");
+  }
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    ThrowErrno(errno, "socket");
+  }
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) <
+          0 ||
+      listen(listen_fd_, SOMAXCONN) < 0) {
+    int err = errno;
+    close(listen_fd_);
+    ThrowErrno(err, "bind/listen");
+  }
+
+  try {
+    ring_ = std::make_unique<Ring>(options_.ring_entries, options_.num_buffers,
+                                   options_.buffer_size);
+  } catch (...) {
+    close(listen_fd_);
+    throw;
+  }
+  if (options_.log_connections) {
+    std::cout << "Server listening on port " << port << " (io_uring)"
+              << std::endl;
+  }
+}
+
+UringServer::~UringServer() {
+  // The armed multishot accept holds a reference to the listening socket,
+  // and the ring is torn down asynchronously, so close() alone would leave
+  // the port bound after we return. shutdown() takes the socket out of the
+  // listen table right away and completes the accept.
+  shutdown(listen_fd_, SHUT_RDWR);
+  for (const auto& [fd, connection] : connections_) {
+    close(fd);
+  }
+  ring_.reset();
+  close(listen_fd_);
+}
+
+void UringServer::Run(const std::function<void()>& on_tick) {
+  // Bounds the wait so that on_tick runs even without traffic.
+  __kernel_timespec tick;
+  tick.tv_sec = 0;
+  tick.tv_nsec = 10 * 1000 * 1000;
+
+  ArmAccept();
+  while (!stopped_.load(std::memory_order_relaxed)) {
+    if (!ring_->Enter(1, IORING_ENTER_GETEVENTS, on_tick ? &tick : nullptr)) {
+      continue;
+    }
+
+    // Reap every available completion before entering the kernel again.
+    unsigned head = *ring_->cq_head;
+    unsigned tail = LoadAcquire(ring_->cq_tail);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = ring_->cqes[head & ring_->cq_mask];
+      int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+      switch (cqe.user_data >> 32) {
+        case kAcceptTag:
+          HandleAccept(cqe.res, cqe.flags);
+          break;
+        case kRecvTag:
+          HandleRecv(fd, cqe.res, cqe.flags);
+          break;
+      }
+    }
+    StoreRelease(ring_->cq_head, head);
+    ring_->PublishBuffers();
+
+    if (on_tick) {
+      on_tick();
+    }
+  }
+}
+
+void UringServer::ArmAccept() {
+  io_uring_sqe* sqe = ring_->GetSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_fd_;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = MakeUserData(kAcceptTag, listen_fd_);
+}
+
+void UringServer::ArmRecv(int fd) {
+  io_uring_sqe* sqe = ring_->GetSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = MakeUserData(kRecvTag, fd);
+}
+
+void UringServer::HandleAccept(int res, uint32_t flags) {
+  if (res >= 0) {
+    if (options_.log_connections) {
+      sockaddr_in peer;
+      socklen_t len = sizeof(peer);
+      char address[INET_ADDRSTRLEN] = "?";
+      if (getpeername(res, reinterpret_cast<sockaddr*>(&peer), &len) == 0) {
+        inet_ntop(AF_INET, &peer.sin_addr, address, sizeof(address));
+      }
+      std::cout << "New connection from " << address << std::endl;
+    }
+    connections_[res];
+    ArmRecv(res);
+  } else {
+    std::cerr << "Accept error: " << std::strerror(-res) << std::endl;
+  }
+  if (!(flags & IORING_CQE_F_MORE)) {
+    ArmAccept();
+  }
+}
+
+void UringServer::HandleRecv(int fd, int res, uint32_t flags) {
+  auto it = connections_.find(fd);
+  if (res > 0 && it != connections_.end()) {
+    uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    it->second.parser.Feed(ring_->Buffer(bid), static_cast<size_t>(res),
+                           handler_);
+  }
+  if (flags & IORING_CQE_F_BUFFER) {
+    RecycleBuffer(static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+  }
+
+  if (res == 0) {
+    CloseConnection(fd);
+  } else if (res < 0 && res != -ENOBUFS) {
+    std::cerr << "Error reading data: " << std::strerror(-res) << std::endl;
+    CloseConnection(fd);
+  } else if (!(flags & IORING_CQE_F_MORE) && it != connections_.end()) {
+    // The multishot request ended (e.g. ran out of buffers); buffers are
+    // republished after this batch, so simply re-arm.
+    ArmRecv(fd);
+  }
+}
+
+void UringServer::RecycleBuffer(uint16_t bid) { ring_->AddBuffer(bid); }
+
+void UringServer::CloseConnection(int fd) {
+  if (connections_.erase(fd) > 0) {
+    close(fd);
+  }
+}
+
+}  // namespace net